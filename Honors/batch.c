@@ -0,0 +1,555 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cells.h"
+#include "trail.h"
+#include "sudoku.h"
+#include "kernels.h"
+#include "stats.h"
+#include "solver.h"
+#include "batch.h"
+
+// Puzzle Reading
+
+// Symbols run 1-9 then A-Z (or a-z) for 10 to 35, as formatSudoku writes
+// them; '.' and '0' are blanks. -1 marks anything else.
+static signed char symbolValues[256];
+static pthread_once_t symbolsOnce = PTHREAD_ONCE_INIT;
+
+static void initSymbols() {
+  memset(symbolValues, -1, sizeof(symbolValues));
+  symbolValues['.'] = 0;
+  symbolValues['0'] = 0;
+  for (int v = 1; v <= SYMBOL_MAX; v++) {
+    if (v < 10) {
+      symbolValues['0' + v] = v;
+    } else {
+      symbolValues['A' + v - 10] = v;
+      symbolValues['a' + v - 10] = v;
+    }
+  }
+}
+
+static int validSize(int sz) {
+  int root = 1;
+  while (root * root < sz)
+    root++;
+  return sz >= 4 && sz <= MAX_SIZE && root * root == sz;
+}
+
+// Header fields are stored least significant byte first
+static void putLittle(unsigned char* p, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++)
+    p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t getLittle(const unsigned char* p, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++)
+    v |= (uint64_t)p[i] << (8 * i);
+  return v;
+}
+
+// Returns 0 for a header that is cut short or not valid
+static int readPackHeader(FILE* in, PackHeader* h) {
+  unsigned char buf[PACK_HEADER_BYTES];
+  if (fread(buf, 1, PACK_HEADER_BYTES, in) != PACK_HEADER_BYTES)
+    return 0;
+  memcpy(h->magic, buf, 4);
+  h->sz = (int32_t)getLittle(buf + 4, 4);
+  h->count = (int64_t)getLittle(buf + PACK_COUNT_OFFSET, 8);
+  return memcmp(h->magic, PACK_MAGIC, 4) == 0 && validSize(h->sz);
+}
+
+// Takes the board size from the header. A regular file is mapped whole;
+// anything else is read a record at a time into the line buffer. Returns 0
+// for a header that is cut short or not valid.
+static int openPacked(PuzzleReader* rd) {
+  PackHeader h;
+  rd->packed = 1;
+  rd->count = 0;
+  if (!readPackHeader(rd->in, &h))
+    return 0;
+  rd->sz = h.sz;
+  long rec = h.sz * h.sz;
+  struct stat st;
+  int fd = fileno(rd->in);
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > PACK_HEADER_BYTES) {
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+      rd->map = map;
+      rd->mapBytes = st.st_size;
+      long whole = (st.st_size - PACK_HEADER_BYTES) / rec;
+      rd->count = h.count >= 0 && h.count < whole ? h.count : whole;
+      return 1;
+    }
+  }
+  rd->count = h.count;
+  rd->lineMax = rec;
+  rd->line = (char*)malloc(rec);
+  return 1;
+}
+
+// Returns 1, or 0 if in starts like a packed file but its header is bad;
+// the reader then has nothing to read, but still needs freeing.
+int initReader(PuzzleReader* rd, FILE* in, int sz) {
+  pthread_once(&symbolsOnce, initSymbols);
+  rd->in = in;
+  rd->sz = sz;
+  rd->line = NULL;
+  rd->lineMax = 0;
+  rd->held = 0;
+  rd->packed = 0;
+  rd->map = NULL;
+  rd->mapBytes = 0;
+  rd->count = 0;
+  rd->next = 0;
+  // Packed files start with a byte no text file does
+  int ch = getc(in);
+  if (ch != EOF)
+    ungetc(ch, in);
+  if (ch == (unsigned char)PACK_MAGIC[0])
+    return openPacked(rd);
+  return 1;
+}
+
+void freeReader(PuzzleReader* rd) {
+  if (rd->map != NULL)
+    munmap((void*)rd->map, rd->mapBytes);
+  free(rd->line);
+}
+
+static int readLine(PuzzleReader* rd) {
+  if (rd->held) {
+    rd->held = 0;
+    return rd->heldLength;
+  }
+  ssize_t n = getline(&rd->line, &rd->lineMax, rd->in);
+  if (n < 0)
+    return -1;
+  while (n > 0 && (rd->line[n - 1] == '\n' || rd->line[n - 1] == '\r'))
+    rd->line[--n] = 0;
+  return n;
+}
+
+// Turns one puzzle line into a value per cell in a single pass over it.
+// Returns 0 if some symbol is not a value on a board of size sz.
+static int decodeLine(const char* line, int ncells, int sz, unsigned char* givens) {
+  int bad = 0;
+  for (int id = 0; id < ncells; id++) {
+    int v = symbolValues[(unsigned char)line[id]];
+    bad |= v < 0 || v > sz;
+    givens[id] = v;
+  }
+  return !bad;
+}
+
+// Returns 1, or 0 if the line is not a puzzle or its givens contradict
+// each other
+static int parseLine(Sudoku* s, const char* line) {
+  int ncells = s->tp->ncells;
+  unsigned char givens[ncells];
+  return decodeLine(line, ncells, s->sz, givens) && loadSudoku(s, givens);
+}
+
+// Returns 1 for a given that was set, 0 for a line that is not a triple
+// (skipped, as importSudoku does), and -1 for a given that cannot be set
+static int parseTriple(Sudoku* s, const char* line) {
+  int row, col, val;
+  if (sscanf(line, "%d %d %d", &row, &col, &val) != 3)
+    return 0;
+  if (row < 1 || row > s->sz || col < 1 || col > s->sz || val < 1 || val > s->sz)
+    return -1;
+  return setCell(s, val, row - 1, col - 1, NULL) == 1 ? 1 : -1;
+}
+
+// Nothing to parse: each byte is a cell's given
+static int readPacked(PuzzleReader* rd, BoardPool* pool, Sudoku** out) {
+  int ncells = rd->sz * rd->sz;
+  const unsigned char* rec;
+  if (rd->count >= 0 && rd->next >= rd->count)
+    return 0;
+  if (rd->map != NULL) {
+    rec = rd->map + PACK_HEADER_BYTES + rd->next * ncells;
+  } else {
+    if (fread(rd->line, 1, ncells, rd->in) != ncells)
+      return 0;
+    rec = (const unsigned char*)rd->line;
+  }
+  rd->next++;
+  Sudoku* s = takeSudoku(pool, rd->sz);
+  if (!loadSudoku(s, rec)) {
+    giveSudoku(pool, s);
+    return -1;
+  }
+  *out = s;
+  return 1;
+}
+
+// Skips the blank lines between records. Returns the length of the next
+// line, or -1 at the end of the input.
+static int nextLine(PuzzleReader* rd) {
+  int n;
+  while ((n = readLine(rd)) == 0) {}
+  return n;
+}
+
+// Whether the line just read, n long, holds a whole puzzle
+static int isPuzzleLine(PuzzleReader* rd, int n) {
+  return n == rd->sz * rd->sz && strchr(rd->line, ' ') == NULL;
+}
+
+// Hands the line just read, n long, to the next readLine again
+static void unreadLine(PuzzleReader* rd, int n) {
+  rd->held = 1;
+  rd->heldLength = n;
+}
+
+static int isTripleLine(PuzzleReader* rd) {
+  int row, col, val;
+  return sscanf(rd->line, "%d %d %d", &row, &col, &val) == 3;
+}
+
+// Whether the line just read starts a block of triples. A block may open
+// with one line that is not a triple, like the solution count the puzzle
+// files here start with, so such a line is only settled by the one after
+// it; if that is no triple either, it is put back.
+static int startsTriples(PuzzleReader* rd) {
+  if (isTripleLine(rd))
+    return 1;
+  int n = readLine(rd);
+  if (n > 0 && isTripleLine(rd))
+    return 1;
+  unreadLine(rd, n);
+  return 0;
+}
+
+// Sets the block of triples starting at the line just read, which runs up
+// to the next blank line. Returns 1, or 0 if a given cannot be set or
+// there are none.
+static int readTriples(PuzzleReader* rd, Sudoku* s) {
+  int givens = 0, bad = 0;
+  do {
+    int er = parseTriple(s, rd->line);
+    if (er < 0)
+      bad = 1;
+    else
+      givens += er;
+  } while (readLine(rd) > 0);
+  return givens > 0 && !bad;
+}
+
+// Reads the next puzzle into *out. Returns 1 for a puzzle, 0 at the end of
+// the input, and -1 for a record that could not be made into a board. A
+// line that is neither a puzzle nor a triple is a record of its own, so
+// one bad line in a file of puzzle lines costs only itself.
+// Boards are taken from pool.
+int readPuzzle(PuzzleReader* rd, BoardPool* pool, Sudoku** out) {
+  if (rd->packed)
+    return readPacked(rd, pool, out);
+  int n = nextLine(rd);
+  if (n < 0)
+    return 0;
+  int whole = isPuzzleLine(rd, n);
+  if (!whole && !startsTriples(rd))
+    return -1;
+  Sudoku* s = takeSudoku(pool, rd->sz);
+  int ok = whole ? parseLine(s, rd->line) : readTriples(rd, s);
+  if (!ok) {
+    giveSudoku(pool, s);
+    return -1;
+  }
+  *out = s;
+  return 1;
+}
+
+// Packed Files
+
+void writePackHeader(FILE* out, int sz) {
+  unsigned char buf[PACK_HEADER_BYTES];
+  memcpy(buf, PACK_MAGIC, 4);
+  putLittle(buf + 4, (uint32_t)sz, 4);
+  putLittle(buf + PACK_COUNT_OFFSET, (uint64_t)(int64_t)-1, 8);
+  fwrite(buf, 1, PACK_HEADER_BYTES, out);
+}
+
+// Fills in the header's record count, if out can seek back to it
+void finishPack(FILE* out, long count) {
+  fflush(out);
+  long end = ftell(out);
+  if (end < 0 || fseek(out, PACK_COUNT_OFFSET, SEEK_SET) != 0)
+    return;
+  unsigned char buf[8];
+  putLittle(buf, (uint64_t)count, 8);
+  fwrite(buf, 1, 8, out);
+  fseek(out, end, SEEK_SET);
+  fflush(out);
+}
+
+void packSudoku(Sudoku* s, unsigned char* rec) {
+  for (int id = 0; id < s->tp->ncells; id++)
+    rec[id] = s->vals[id];
+}
+
+// Reads the next puzzle straight into a packed record, returning as
+// readPuzzle does. A puzzle line is only decoded and checked for clashes,
+// with no board built; triples and packed input still go through one.
+static int packNext(PuzzleReader* rd, BoardPool* pool, const Topology* tp, unsigned char* rec) {
+  Sudoku* s;
+  if (rd->packed) {
+    int er = readPacked(rd, pool, &s);
+    if (er == 1) {
+      packSudoku(s, rec);
+      giveSudoku(pool, s);
+    }
+    return er;
+  }
+  int n = nextLine(rd);
+  if (n < 0)
+    return 0;
+  if (isPuzzleLine(rd, n))
+    return decodeLine(rd->line, tp->ncells, tp->sz, rec) && checkGivens(tp, rec) ? 1 : -1;
+  if (!startsTriples(rd))
+    return -1;
+  s = takeSudoku(pool, rd->sz);
+  int ok = readTriples(rd, s);
+  if (ok)
+    packSudoku(s, rec);
+  giveSudoku(pool, s);
+  return ok ? 1 : -1;
+}
+
+// Converts every puzzle in a text (or packed) file to a packed file of its
+// givens. Returns the number of records written, or -1 (having written
+// nothing) if in has a bad packed header. A line whose givens clash is
+// written as an invalid record, but one that only leaves a cell without a
+// candidate is packed as it is; solving it finds it invalid.
+long packPuzzles(FILE* in, FILE* out, int sz) {
+  PuzzleReader rd;
+  if (!initReader(&rd, in, sz)) {
+    freeReader(&rd);
+    return -1;
+  }
+  const Topology* tp = getTopology(rd.sz);
+  int ncells = tp->ncells;
+  unsigned char rec[ncells];
+  writePackHeader(out, rd.sz);
+  long count = 0;
+  // Only triples and packed input need a board, and they all share one
+  BoardPool* pool = makePool();
+  int er;
+  while ((er = packNext(&rd, pool, tp, rec)) != 0) {
+    if (er < 0)
+      memset(rec, PACK_INVALID, ncells);
+    fwrite(rec, 1, ncells, out);
+    count++;
+  }
+  finishPack(out, count);
+  freePool(pool);
+  freeReader(&rd);
+  return count;
+}
+
+// Result Writing
+
+// The line written for a puzzle: its solution, its solution count, or
+// what became of it
+static char* describeResult(const Result* r, Sudoku* grid, int counting) {
+  if (grid != NULL)
+    return formatSudoku(grid);
+  if (r->status == BATCH_INVALID)
+    return strdup("invalid");
+  if (r->status == BATCH_UNFINISHED)
+    return strdup("unfinished");
+  if (counting) {
+    char* text = (char*)malloc(24);
+    sprintf(text, "%ld", r->count);
+    return text;
+  }
+  return strdup("no solution");
+}
+
+static char* packResult(const Result* r, Sudoku* grid, int sz) {
+  unsigned char* rec = (unsigned char*)malloc(sz * sz);
+  if (grid != NULL)
+    packSudoku(grid, rec);
+  else
+    memset(rec, r->status == BATCH_INVALID ? PACK_INVALID : 0, sz * sz);
+  return (char*)rec;
+}
+
+// Takes ownership of s, which is NULL for a record that could not be read
+static Result solveOne(BatchWorker* w, Sudoku* s) {
+  Result r = {BATCH_INVALID, NULL, 0, 0};
+  Sudoku* grid = NULL;
+  if (s != NULL) {
+    // Budgets are per puzzle, so each one starts from a clean slate
+    double start = wallClock();
+    resetShared(&w->shr);
+    solveJob(&w->w, s);
+    r.secs = wallClock() - start;
+
+    int stop = w->shr.stop.reason;
+    r.count = w->shr.found;
+    if (w->opts.limit > 0 && r.count > w->opts.limit)
+      r.count = w->opts.limit;
+    Solutions* sols = w->shr.solutions;
+    if (w->opts.countOnly && (stop == STOP_NONE || stop == STOP_LIMIT)) {
+      r.status = r.count > 0 ? BATCH_SOLVED : BATCH_UNSOLVABLE;
+    } else if (sols->numSols > 0) {
+      r.status = BATCH_SOLVED;
+      grid = sols->solutions[0];
+    } else if (stop != STOP_NONE) {
+      r.status = BATCH_UNFINISHED;
+    } else {
+      r.status = BATCH_UNSOLVABLE;
+    }
+  }
+  if (w->b->packed)
+    r.text = packResult(&r, grid, w->b->rd.sz);
+  else
+    r.text = describeResult(&r, grid, w->opts.countOnly);
+  return r;
+}
+
+// Files r under its number and writes out every result that is now next.
+// shr holds the puzzle's search figures, or is NULL if it was never searched.
+static void postResult(Batch* b, int seq, Result r, const SharedInfo* shr) {
+  pthread_mutex_lock(&b->outMtx);
+  b->results[seq % b->window] = r;
+  b->ready[seq % b->window] = 1;
+  if (shr != NULL) {
+    b->stats.nodes += shr->jobNodes;
+    mergeStats(&b->stats.search, &shr->stats);
+  }
+  while (b->ready[b->nextOut % b->window]) {
+    int slot = b->nextOut % b->window;
+    if (b->packed) {
+      fwrite(b->results[slot].text, 1, b->rd.sz * b->rd.sz, b->out);
+    } else {
+      fputs(b->results[slot].text, b->out);
+      fputc('\n', b->out);
+    }
+    b->stats.counts[b->results[slot].status]++;
+    b->stats.solutions += b->results[slot].count;
+    b->times[b->nextOut] = b->results[slot].secs;
+    free(b->results[slot].text);
+    b->ready[slot] = 0;
+    b->nextOut++;
+  }
+  pthread_cond_broadcast(&b->room);
+  pthread_mutex_unlock(&b->outMtx);
+}
+
+// Threading
+
+static void* batchThread(void* args) {
+  BatchWorker* w = args;
+  Batch* b = w->b;
+  // Once the caller cancels, puzzles already read are settled or marked
+  // unfinished, and the rest of the input is left unread
+  while (b->opts->cancel == NULL || checkCancel(b->opts->cancel) == STOP_NONE) {
+    Sudoku* s = NULL;
+    pthread_mutex_lock(&b->inMtx);
+    int er = readPuzzle(&b->rd, w->w.pool, &s);
+    int seq = b->nextIn;
+    if (er != 0)
+      b->nextIn++;
+    pthread_mutex_unlock(&b->inMtx);
+    if (er == 0)
+      break;
+
+    // Don't get more than a window ahead of the writer, and make room to
+    // keep this puzzle's time
+    pthread_mutex_lock(&b->outMtx);
+    while (seq >= b->nextOut + b->window)
+      pthread_cond_wait(&b->room, &b->outMtx);
+    if (seq >= b->maxTimes) {
+      b->maxTimes *= 2;
+      b->times = (double*)realloc(b->times, sizeof(double) * b->maxTimes);
+    }
+    pthread_mutex_unlock(&b->outMtx);
+
+    Result r = solveOne(w, s);
+    postResult(b, seq, r, s == NULL ? NULL : &w->shr);
+  }
+  return NULL;
+}
+
+static int compareTimes(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+BatchStats solveBatch(FILE* in, FILE* out, int sz, int nt, const Options* o, int packed) {
+  double start = wallClock();
+
+  Batch b;
+  if (!initReader(&b.rd, in, sz)) {
+    BatchStats bad;
+    memset(&bad, 0, sizeof(bad));
+    bad.badInput = 1;
+    freeReader(&b.rd);
+    return bad;
+  }
+  b.out = out;
+  b.packed = packed;
+  if (packed)
+    writePackHeader(out, b.rd.sz);
+  b.opts = o;
+  b.nextIn = 0;
+  b.nextOut = 0;
+  b.window = 64 * nt;
+  b.results = (Result*)malloc(sizeof(Result) * b.window);
+  b.ready = (char*)calloc(b.window, 1);
+  b.maxTimes = 1024;
+  b.times = (double*)malloc(sizeof(double) * b.maxTimes);
+  memset(&b.stats, 0, sizeof(b.stats));
+  pthread_mutex_init(&b.inMtx, NULL);
+  pthread_mutex_init(&b.outMtx, NULL);
+  pthread_cond_init(&b.room, NULL);
+
+  BatchWorker workers[nt];
+  for (int i = 0; i < nt; i++) {
+    workers[i].b = &b;
+    workers[i].opts = *o;
+    // Unless counting, the first solution is all that gets written, and
+    // it is written here rather than to any sink
+    if (!o->countOnly)
+      workers[i].opts.limit = 1;
+    workers[i].opts.sink = NULL;
+    initShared(&workers[i].shr, 1, &workers[i].opts);
+    initWorker(&workers[i].w, 0, &workers[i].shr);
+    pthread_create(&workers[i].name, NULL, batchThread, &workers[i]);
+  }
+  for (int i = 0; i < nt; i++) {
+    pthread_join(workers[i].name, NULL);
+    freeWorker(&workers[i].w);
+    freeSStack(workers[i].shr.solutions);
+    freeShared(&workers[i].shr);
+  }
+  if (packed)
+    finishPack(out, b.nextOut);
+  fflush(out);
+
+  b.stats.puzzles = b.nextIn;
+  b.stats.secs = wallClock() - start;
+  if (b.nextOut > 0) {
+    qsort(b.times, b.nextOut, sizeof(double), compareTimes);
+    b.stats.median = b.times[b.nextOut / 2];
+    b.stats.p99 = b.times[(int)(b.nextOut * 0.99)];
+  }
+  pthread_mutex_destroy(&b.inMtx);
+  pthread_mutex_destroy(&b.outMtx);
+  pthread_cond_destroy(&b.room);
+  free(b.results);
+  free(b.ready);
+  free(b.times);
+  freeReader(&b.rd);
+  return b.stats;
+}
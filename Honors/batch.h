@@ -0,0 +1,114 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// Outcome of one puzzle in a batch
+#define BATCH_SOLVED 0
+#define BATCH_UNSOLVABLE 1
+#define BATCH_INVALID 2
+#define BATCH_UNFINISHED 3  // cancelled before it was settled
+
+// Packed files hold fixed-size records after a PackHeader: one byte per
+// cell in row order, 0 for a blank. Puzzle files store the givens, and
+// solution files the solved grid, all zero when a puzzle has none. A
+// record filled with PACK_INVALID stands for a puzzle that could not be
+// read.
+#define PACK_MAGIC "\x89SDK"
+#define PACK_INVALID 0xff
+
+// On disk the header is PACK_HEADER_BYTES long whatever the machine: the
+// magic, the size as 4 bytes, then the count as 8, both little-endian
+#define PACK_HEADER_BYTES 16
+#define PACK_COUNT_OFFSET 8
+
+typedef struct PackHeader {
+  char magic[4];
+  int32_t sz;
+  int64_t count;  // records that follow, -1 for up to the end of the file
+} PackHeader;
+
+// Reads puzzles one after another: one line of sz * sz symbols per puzzle
+// ('.' or '0' for blanks), blocks of "row col val" lines separated by
+// blank lines, or a packed file. Packed files are mapped into memory when
+// they can be, so their records are used where they lie.
+typedef struct PuzzleReader {
+  FILE* in;
+  int sz;
+  char* line;
+  size_t lineMax;
+  int held;       // whether line was read ahead and put back
+  int heldLength;
+  int packed;
+  const unsigned char* map;  // the whole file, NULL when it is read instead
+  long mapBytes;
+  long count;     // records in a packed file
+  long next;      // next record to read from it
+} PuzzleReader;
+
+typedef struct Result {
+  int status;
+  char* text;   // the line (or packed record) written for this puzzle
+  long count;   // solutions found for it
+  double secs;  // time spent solving it
+} Result;
+
+typedef struct BatchStats {
+  int puzzles;
+  int counts[4];  // results written, by status
+  long solutions;
+  long nodes;
+  double secs;
+  double median;  // of the per-puzzle solve times
+  double p99;
+  Stats search;   // merged from every puzzle
+  int badInput;   // the input looked packed but its header was not valid
+} BatchStats;
+
+// A stream of puzzles solved by a pool of threads. Puzzles are numbered as
+// they are read, and results are written strictly in that order through a
+// ring of window slots; readers wait when they get a window ahead.
+typedef struct Batch {
+  PuzzleReader rd;
+  FILE* out;
+  int packed;     // whether results are written as packed records
+  const Options* opts;
+  int nextIn;     // number given to the next puzzle read
+  int nextOut;    // number of the next result to be written
+  int window;
+  Result* results;
+  char* ready;
+  double* times;  // solve time of every puzzle, by number
+  int maxTimes;
+  BatchStats stats;
+  pthread_mutex_t inMtx;
+  pthread_mutex_t outMtx;
+  pthread_cond_t room;
+} Batch;
+
+// Each worker searches alone, for one solution per puzzle
+typedef struct BatchWorker {
+  Batch* b;
+  Options opts;
+  SharedInfo shr;
+  ThreadInfo w;
+  pthread_t name;
+} BatchWorker;
+
+// Puzzle Reading
+int initReader(PuzzleReader* rd, FILE* in, int sz);
+void freeReader(PuzzleReader* rd);
+int readPuzzle(PuzzleReader* rd, BoardPool* pool, Sudoku** out);
+
+// Packed Files
+void writePackHeader(FILE* out, int sz);
+void finishPack(FILE* out, long count);
+void packSudoku(Sudoku* s, unsigned char* rec);
+long packPuzzles(FILE* in, FILE* out, int sz);
+
+// Batch Solving
+// Writes one line per puzzle: its first solution, or with o->countOnly how
+// many solutions it has (up to o->limit). With packed set, solutions are
+// written as a packed file instead. Nothing is solved or written if the
+// input has a bad packed header.
+BatchStats solveBatch(FILE* in, FILE* out, int sz, int nt, const Options* o, int packed);
+
+#endif
@@ -0,0 +1,68 @@
+#!/bin/sh
+# Solves each bundled corpus with 1 up to BENCH_THREADS threads (doubling,
+# default every core) and writes one CSV row per run to bench/results.csv,
+# keeping the fastest of BENCH_RUNS tries (default 3) to damp noise.
+# If bench/baseline.csv exists, rows whose throughput fell more than
+# BENCH_TOLERANCE percent (default 10) below it are reported, and the
+# script exits 1. BENCH_FLAGS is passed on to every solve, e.g.
+# BENCH_FLAGS="-u trail" to compare the undo methods.
+#
+# Run from the Honors directory, normally through "make bench".
+
+SOLVER=${SOLVER:-./solver}
+MAX=${BENCH_THREADS:-$(nproc 2>/dev/null || echo 1)}
+RUNS=${BENCH_RUNS:-3}
+TOLERANCE=${BENCH_TOLERANCE:-10}
+RESULTS=bench/results.csv
+BASELINE=bench/baseline.csv
+
+# corpus size flags
+CORPORA="easy 9 -
+hard 9 -
+17clue 9 -
+multi 9 -q
+16x16 16 -"
+
+THREADS=1
+t=2
+while [ $t -lt "$MAX" ]; do
+  THREADS="$THREADS $t"
+  t=$((t * 2))
+done
+[ "$MAX" -gt 1 ] && THREADS="$THREADS $MAX"
+
+echo "corpus,threads,puzzles,solved,puzzles_per_sec,median_ms,p99_ms,nodes_per_puzzle" > $RESULTS
+echo "$CORPORA" | while read corpus sz flags; do
+  [ "$flags" = "-" ] && flags=
+  for nt in $THREADS; do
+    # The summary's second line: puzzles,solved,unsolvable,invalid,unfinished,
+    # solutions,seconds,puzzles_per_sec,median_ms,p99_ms,nodes,nodes_per_puzzle
+    row=
+    run=0
+    while [ $run -lt "$RUNS" ]; do
+      try=$($SOLVER -B -f csv -n $sz -t $nt $flags $BENCH_FLAGS -i bench/$corpus.txt 2>&1 >/dev/null | sed -n 2p)
+      if [ -z "$try" ]; then
+	echo "bench: $corpus with $nt threads failed" >&2
+	exit 1
+      fi
+      if [ -z "$row" ] || [ "$(echo "$try $row" | awk -F'[ ,]' '{ print ($8 > $20) }')" = 1 ]; then
+	row=$try
+      fi
+      run=$((run + 1))
+    done
+    echo "$row" | awk -F, -v c=$corpus -v t=$nt '{ printf "%s,%d,%d,%d,%s,%s,%s,%s\n", c, t, $1, $2, $8, $9, $10, $12 }' >> $RESULTS
+  done
+done || exit 1
+cat $RESULTS
+
+[ -f $BASELINE ] || exit 0
+awk -F, -v tol=$TOLERANCE '
+  NR == FNR { if (FNR > 1) base[$1 "," $2] = $5; next }
+  FNR > 1 && ($1 "," $2) in base && base[$1 "," $2] > 0 {
+    drop = 100 * (1 - $5 / base[$1 "," $2])
+    if (drop > tol) {
+      printf "bench: %s with %d threads dropped %.1f%% (%.1f -> %.1f puzzles/sec)\n", $1, $2, drop, base[$1 "," $2], $5
+      bad = 1
+    }
+  }
+  END { exit bad }' $BASELINE $RESULTS
@@ -1,29 +1,106 @@
 #ifndef CELLS_H
 #define CELLS_H
 
-typedef struct Cell {
-  int id;
-  int val;
-  int ngs;
-  int* gs;
-} Cell;
-
-typedef struct Group {
-  int max;
-  int ncs;
-  Cell** cs;
-} Group;
-
-// Basic Cell Functions
-Cell* makeCell(int s, int id);
-void freeCell(Cell* c);
-void setValue(Cell* c, int v, int sz);
-int removeGuess(Cell* c, int n);
-void printCell(Cell* c, int size);
-Cell* copyCell(Cell* orig, int s);
-// Basic Group Functions
-Group* makeGroup(int max);
-int addCell(Group* g, Cell* c);
-void freeGroup(Group* g);
+#include <stdint.h>
+
+// Candidate masks: digit d lives in bit (d - 1) of word (d - 1) / 64.
+// Sizes up to 64 use a single word, 81 needs two.
+#define WORD_BITS 64
+#define MAX_WORDS 2
+
+typedef uint64_t Word;
+
+// Candidate Mask Functions
+static inline int maskWords(int sz) {
+  return (sz + WORD_BITS - 1) / WORD_BITS;
+}
+
+static inline void maskClear(Word* m, int nw) {
+  for (int i = 0; i < nw; i++)
+    m[i] = 0;
+}
+
+static inline void maskFill(Word* m, int sz) {
+  int nw = maskWords(sz);
+  for (int i = 0; i < nw; i++)
+    m[i] = ~(Word)0;
+  if (sz % WORD_BITS != 0)
+    m[nw - 1] = ((Word)1 << (sz % WORD_BITS)) - 1;
+}
+
+static inline int maskHas(const Word* m, int d) {
+  return (m[(d - 1) / WORD_BITS] >> ((d - 1) % WORD_BITS)) & 1;
+}
+
+static inline void maskAdd(Word* m, int d) {
+  m[(d - 1) / WORD_BITS] |= (Word)1 << ((d - 1) % WORD_BITS);
+}
+
+static inline void maskRemove(Word* m, int d) {
+  m[(d - 1) / WORD_BITS] &= ~((Word)1 << ((d - 1) % WORD_BITS));
+}
+
+static inline int maskCount(const Word* m, int nw) {
+  int n = 0;
+  for (int i = 0; i < nw; i++)
+    n += __builtin_popcountll(m[i]);
+  return n;
+}
+
+static inline int maskEmpty(const Word* m, int nw) {
+  for (int i = 0; i < nw; i++)
+    if (m[i] != 0)
+      return 0;
+  return 1;
+}
+
+// Lowest digit in m, or -1 if m is empty
+static inline int maskFirst(const Word* m, int nw) {
+  for (int i = 0; i < nw; i++)
+    if (m[i] != 0)
+      return i * WORD_BITS + __builtin_ctzll(m[i]) + 1;
+  return -1;
+}
+
+// Lowest digit in m greater than d, or -1 if there is none
+static inline int maskNext(const Word* m, int nw, int d) {
+  int i = d / WORD_BITS;
+  if (i >= nw)
+    return -1;
+  Word w = d % WORD_BITS == 0 ? m[i] : m[i] & (~(Word)0 << (d % WORD_BITS));
+  while (w == 0) {
+    if (++i == nw)
+      return -1;
+    w = m[i];
+  }
+  return i * WORD_BITS + __builtin_ctzll(w) + 1;
+}
+
+static inline void maskCopy(Word* dst, const Word* src, int nw) {
+  for (int i = 0; i < nw; i++)
+    dst[i] = src[i];
+}
+
+static inline void maskOr(Word* dst, const Word* src, int nw) {
+  for (int i = 0; i < nw; i++)
+    dst[i] |= src[i];
+}
+
+static inline void maskAnd(Word* dst, const Word* src, int nw) {
+  for (int i = 0; i < nw; i++)
+    dst[i] &= src[i];
+}
+
+static inline void maskAndNot(Word* dst, const Word* src, int nw) {
+  for (int i = 0; i < nw; i++)
+    dst[i] &= ~src[i];
+}
+
+static inline int maskIntersects(const Word* a, const Word* b, int nw) {
+  for (int i = 0; i < nw; i++)
+    if ((a[i] & b[i]) != 0)
+      return 1;
+  return 0;
+}
 
 #endif
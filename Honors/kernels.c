@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "cells.h"
+#include "trail.h"
+#include "sudoku.h"
+#include "kernels.h"
+#include "stats.h"
+
+#define KUNROLL_FULL _Pragma("GCC unroll 32")
+
+// Fixed-size kernels: everything is derived from the size and box root
+
+#define KNW 1
+#define KNCELLS (KSZ * KSZ)
+#define KNUNITS (3 * KSZ)
+#define KNPEERS (2 * (KSZ - 1) + (KROOT - 1) * (KROOT - 1))
+
+#define KFN(name) name##4
+#define KSZ 4
+#define KROOT 2
+#define KUNROLL KUNROLL_FULL
+#include "kernel.inc"
+#undef KFN
+#undef KSZ
+#undef KROOT
+#undef KUNROLL
+
+#define KFN(name) name##9
+#define KSZ 9
+#define KROOT 3
+#define KUNROLL KUNROLL_FULL
+#include "kernel.inc"
+#undef KFN
+#undef KSZ
+#undef KROOT
+#undef KUNROLL
+
+#define KFN(name) name##16
+#define KSZ 16
+#define KROOT 4
+#define KUNROLL
+#include "kernel.inc"
+#undef KFN
+#undef KSZ
+#undef KROOT
+#undef KUNROLL
+
+#define KFN(name) name##25
+#define KSZ 25
+#define KROOT 5
+#define KUNROLL
+#include "kernel.inc"
+#undef KFN
+#undef KSZ
+#undef KROOT
+#undef KUNROLL
+
+#undef KNW
+#undef KNCELLS
+#undef KNUNITS
+#undef KNPEERS
+
+// Generic kernel for every other size
+
+#define KFN(name) name##N
+#define KSZ (s->sz)
+#define KNW (s->nw)
+#define KNCELLS (s->tp->ncells)
+#define KNUNITS (s->tp->nunits)
+#define KNPEERS (s->tp->npeers)
+#define KUNROLL
+#include "kernel.inc"
+#undef KFN
+#undef KSZ
+#undef KNW
+#undef KNCELLS
+#undef KNUNITS
+#undef KNPEERS
+#undef KUNROLL
+
+const Kernel* getKernel(int sz) {
+  switch (sz) {
+  case 4:
+    return &kernel4;
+  case 9:
+    return &kernel9;
+  case 16:
+    return &kernel16;
+  case 25:
+    return &kernel25;
+  default:
+    return &kernelN;
+  }
+}
@@ -0,0 +1,36 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+// Branching strategies for picking the next cell to guess
+#define BRANCH_FIRST 0
+#define BRANCH_MRV 1
+#define BRANCH_MRV_DEGREE 2
+
+// Size-specialized propagation and search routines. Boards pick theirs
+// when they are made; see kernel.inc for the shared implementation.
+typedef struct Kernel {
+  int (*setCell)(Sudoku* s, int v, int id, Trail* t);
+  int (*removeGuess)(Sudoku* s, int id, int n, Trail* t);
+  int (*scan)(Sudoku* s, Trail* t, int maxSubset);
+  int (*findGuessCell)(Sudoku* s, int branch);
+  void (*rewind)(Sudoku* s, Trail* t, int to);
+  int (*chainRestore)(Marks* m, Trail* t, Sudoku* s, int undos);
+} Kernel;
+
+const Kernel* getKernel(int sz);
+
+// Steps idx through the k-element combinations of 0..n-1 in lexicographic
+// order; returns 0 once the last one has been passed
+static inline int nextCombination(int* idx, int k, int n) {
+  int i = k - 1;
+  while (i >= 0 && idx[i] == n - k + i)
+    i--;
+  if (i < 0)
+    return 0;
+  idx[i]++;
+  for (int j = i + 1; j < k; j++)
+    idx[j] = idx[j - 1] + 1;
+  return 1;
+}
+
+#endif
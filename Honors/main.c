@@ -0,0 +1,608 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include "cells.h"
+#include "trail.h"
+#include "sudoku.h"
+#include "kernels.h"
+#include "stats.h"
+#include "solver.h"
+#include "batch.h"
+
+#define DEFAULT_OPTIONS {BRANCH_MRV, 2, 4, 1, 0, 0, UNDO_AUTO, 0, 0, 0, NULL, NULL}
+
+// Output formats for the command-line driver
+#define FORMAT_TEXT 0
+#define FORMAT_JSON 1
+#define FORMAT_CSV 2
+
+static const char* stopNames[] = {"none", "limit", "deadline", "abort", "nodes", "trail"};
+
+// Ctrl-C cancels the running solve instead of killing the process
+static CancelToken* interrupted = NULL;
+
+void onInterrupt(int sig) {
+  if (interrupted != NULL)
+    cancelSearch(interrupted, STOP_ABORT);
+}
+
+#ifdef SOLVER_STATS
+static const char* ruleNames[] = {"singles", "hidden", "subsets"};
+
+void printStats(FILE* f, const Stats* st, int format) {
+  double perNode = st->nodes > 0 ? (double)st->passes / st->nodes : 0;
+  if (format == FORMAT_JSON) {
+    fprintf(f, ", \"stats\": {\"nodes\": %ld, \"backtracks\": %ld, \"singles\": %ld, \"hiddenSingles\": %ld, "
+	    "\"subsetElims\": %ld, \"passes\": %ld, \"passesPerNode\": %.3f, \"trailPeak\": %ld",
+	    st->nodes, st->backtracks, st->singles, st->hiddenSingles, st->subsetElims, st->passes, perNode,
+	    st->trailPeak);
+    for (int i = 0; i < NUM_RULES; i++)
+      fprintf(f, ", \"%sSecs\": %.6f", ruleNames[i], st->ruleSecs[i]);
+    fprintf(f, "}");
+  } else if (format == FORMAT_CSV) {
+    fprintf(f, "%ld,%ld,%ld,%ld,%ld,%ld,%ld", st->nodes, st->backtracks, st->singles, st->hiddenSingles,
+	    st->subsetElims, st->passes, st->trailPeak);
+    for (int i = 0; i < NUM_RULES; i++)
+      fprintf(f, ",%.6f", st->ruleSecs[i]);
+  } else {
+    fprintf(f, "Search: %ld nodes, %ld backtracks, %.2f passes per node, trail peak %ld.\n",
+	    st->nodes, st->backtracks, perNode, st->trailPeak);
+    fprintf(f, "Rules: %ld singles, %ld hidden singles, %ld subset eliminations.\n",
+	    st->singles, st->hiddenSingles, st->subsetElims);
+    fprintf(f, "Rule time:");
+    for (int i = 0; i < NUM_RULES; i++)
+      fprintf(f, " %s %.6fs", ruleNames[i], st->ruleSecs[i]);
+    fprintf(f, "\n");
+  }
+}
+#endif
+
+// Solve times are reported in milliseconds
+void printBatchStats(FILE* f, const BatchStats* st, int format) {
+  double rate = st->secs > 0 ? st->puzzles / st->secs : 0;
+  double perPuzzle = st->puzzles > 0 ? (double)st->nodes / st->puzzles : 0;
+  if (format == FORMAT_JSON) {
+    fprintf(f, "{\"puzzles\": %d, \"solved\": %d, \"unsolvable\": %d, \"invalid\": %d, \"unfinished\": %d, "
+	    "\"solutions\": %ld, \"seconds\": %.6f, \"puzzlesPerSec\": %.1f, \"medianMs\": %.3f, \"p99Ms\": %.3f, "
+	    "\"nodes\": %ld, \"nodesPerPuzzle\": %.1f", st->puzzles, st->counts[BATCH_SOLVED],
+	    st->counts[BATCH_UNSOLVABLE], st->counts[BATCH_INVALID], st->counts[BATCH_UNFINISHED], st->solutions,
+	    st->secs, rate, st->median * 1000, st->p99 * 1000, st->nodes, perPuzzle);
+#ifdef SOLVER_STATS
+    printStats(f, &st->search, FORMAT_JSON);
+#endif
+    fprintf(f, "}\n");
+  } else if (format == FORMAT_CSV) {
+    fprintf(f, "puzzles,solved,unsolvable,invalid,unfinished,solutions,seconds,puzzles_per_sec,median_ms,p99_ms,nodes,nodes_per_puzzle\n");
+    fprintf(f, "%d,%d,%d,%d,%d,%ld,%.6f,%.1f,%.3f,%.3f,%ld,%.1f\n", st->puzzles, st->counts[BATCH_SOLVED],
+	    st->counts[BATCH_UNSOLVABLE], st->counts[BATCH_INVALID], st->counts[BATCH_UNFINISHED], st->solutions,
+	    st->secs, rate, st->median * 1000, st->p99 * 1000, st->nodes, perPuzzle);
+  } else {
+    fprintf(f, "Read %d puzzles: %d solved, %d unsolvable, %d invalid, %d unfinished.\n", st->puzzles,
+	    st->counts[BATCH_SOLVED], st->counts[BATCH_UNSOLVABLE], st->counts[BATCH_INVALID],
+	    st->counts[BATCH_UNFINISHED]);
+    fprintf(f, "Took %.3f seconds (%.0f puzzles/sec, %ld guesses).\n", st->secs, rate, st->nodes);
+    fprintf(f, "Per puzzle: median %.3f ms, p99 %.3f ms, %.1f guesses.\n", st->median * 1000, st->p99 * 1000,
+	    perPuzzle);
+#ifdef SOLVER_STATS
+    printStats(f, &st->search, FORMAT_TEXT);
+#endif
+  }
+}
+
+// Interactive Mode
+
+void printCommands() {
+  printf("help - print a list of commands\n");
+  printf("quit - quit the program\n");
+  printf("import - import a sudoku\n");
+  printf("run - solve the imported sudoku\n");
+  printf("batch - solve every puzzle in a file\n");
+  printf("branch - choose how guesses are branched on\n");
+  printf("subsets - set the largest naked/hidden subset to look for\n");
+  printf("split - set how finely threaded runs divide the board\n");
+  printf("limit - stop after finding this many solutions\n");
+  printf("undo - choose how guesses are undone\n");
+  printf("stream - write threaded runs' solutions to a file as they are found\n");
+}
+
+// Interactive mode, used when no flags are given
+int runRepl() {
+  char buffer[128];
+  char streamPath[128] = "";  // where threaded runs write solutions, "" keeps them
+  int running = 1;
+  Sudoku* s = NULL;
+  Options opts = DEFAULT_OPTIONS;
+  while (running) {
+    // Receive command
+    printf("> "); fflush(stdout);
+    int i = 0;
+    char ch;
+    while (i < sizeof(buffer) - 1 && (ch = getchar()) != '\n' && ch != EOF)
+      buffer[i++] = ch;
+    buffer[i] = 0;
+    if (strcmp("q", buffer) == 0 || strcmp("quit", buffer) == 0) {
+      if (s != NULL)
+	freeSudoku(s);
+      running = 0;
+    } else if (strcmp("h", buffer) == 0 || strcmp("help", buffer) == 0) {
+      printCommands();
+    } else if (strcmp("i", buffer) == 0 || strcmp("import", buffer) == 0) {
+      int sz;
+      printf("What size sudoku are you importing?\n");
+      int er = scanf("%d", &sz);
+      while(ch = getchar() != '\n'){}
+      if (er < 1 || sz < 4 || sz > 81 || sqrt(sz) * sqrt(sz) != sz) {
+	printf("Invalid size. Aborting import.\n");
+	continue;
+      }
+      printf("What file would you like to import?\n");
+      i = 0;
+      while (i < sizeof(buffer) - 1 && (ch = getchar()) != '\n' && ch != EOF)
+	buffer[i++] = ch;
+      buffer[i] = 0;
+      s = importSudoku(buffer, sz);
+      if (s == NULL) {
+	printf("File name invalid. Aborting import..\n");
+      }
+    } else if (strcmp("batch", buffer) == 0) {
+      int sz, nt;
+      printf("What size are the puzzles?\n");
+      int er = scanf("%d", &sz);
+      while(ch = getchar() != '\n'){}
+      if (er < 1 || sz < 4 || sz > 81 || sqrt(sz) * sqrt(sz) != sz) {
+	printf("Invalid size. Aborting batch.\n");
+	continue;
+      }
+      printf("What file are the puzzles in?\n");
+      i = 0;
+      while (i < sizeof(buffer) - 1 && (ch = getchar()) != '\n' && ch != EOF)
+	buffer[i++] = ch;
+      buffer[i] = 0;
+      FILE* in = fopen(buffer, "r");
+      if (in == NULL) {
+	printf("File name invalid. Aborting batch.\n");
+	continue;
+      }
+      printf("Where should solutions go? (blank for the screen)\n");
+      i = 0;
+      while (i < sizeof(buffer) - 1 && (ch = getchar()) != '\n' && ch != EOF)
+	buffer[i++] = ch;
+      buffer[i] = 0;
+      FILE* out = i == 0 ? stdout : fopen(buffer, "w");
+      if (out == NULL) {
+	printf("Cannot write to that file. Aborting batch.\n");
+	fclose(in);
+	continue;
+      }
+      printf("How many threads?\n");
+      er = scanf("%d", &nt);
+      while(ch = getchar() != '\n'){}
+      if (er < 1 || nt < 1) {
+	printf("Invalid count. Aborting batch.\n");
+      } else {
+	BatchStats st = solveBatch(in, out, sz, nt, &opts, 0);
+	if (st.badInput)
+	  printf("Not a valid packed file. Aborting batch.\n");
+	else
+	  printBatchStats(stdout, &st, FORMAT_TEXT);
+      }
+      fclose(in);
+      if (out != stdout)
+	fclose(out);
+    } else if (strcmp("b", buffer) == 0 || strcmp("branch", buffer) == 0) {
+      printf("Which branching strategy? (first/mrv/degree)\n");
+      i = 0;
+      while (i < sizeof(buffer) - 1 && (ch = getchar()) != '\n' && ch != EOF)
+	buffer[i++] = ch;
+      buffer[i] = 0;
+      if (strcmp("first", buffer) == 0) {
+	opts.branch = BRANCH_FIRST;
+      } else if (strcmp("mrv", buffer) == 0) {
+	opts.branch = BRANCH_MRV;
+      } else if (strcmp("degree", buffer) == 0) {
+	opts.branch = BRANCH_MRV_DEGREE;
+      } else {
+	printf("Unknown strategy. Keeping the current one.\n");
+      }
+    } else if (strcmp("u", buffer) == 0 || strcmp("undo", buffer) == 0) {
+      printf("How should guesses be undone? (auto/trail/snapshot)\n");
+      i = 0;
+      while (i < sizeof(buffer) - 1 && (ch = getchar()) != '\n' && ch != EOF)
+	buffer[i++] = ch;
+      buffer[i] = 0;
+      if (strcmp("auto", buffer) == 0) {
+	opts.undo = UNDO_AUTO;
+      } else if (strcmp("trail", buffer) == 0) {
+	opts.undo = UNDO_TRAIL;
+      } else if (strcmp("snapshot", buffer) == 0) {
+	opts.undo = UNDO_SNAPSHOT;
+      } else {
+	printf("Unknown method. Keeping the current one.\n");
+      }
+    } else if (strcmp("w", buffer) == 0 || strcmp("stream", buffer) == 0) {
+      printf("Write solutions of threaded runs to a file as they are found? (file name, blank to keep them)\n");
+      i = 0;
+      while (i < sizeof(streamPath) - 1 && (ch = getchar()) != '\n' && ch != EOF)
+	streamPath[i++] = ch;
+      streamPath[i] = 0;
+    } else if (strcmp("s", buffer) == 0 || strcmp("subsets", buffer) == 0) {
+      printf("Largest subset size? (0 to disable subset rules)\n");
+      int max;
+      int er = scanf("%d", &max);
+      while(ch = getchar() != '\n'){}
+      if (er < 1 || max < 0) {
+	printf("Invalid size. Keeping the current one.\n");
+	continue;
+      }
+      opts.subsets = max;
+    } else if (strcmp("l", buffer) == 0 || strcmp("limit", buffer) == 0) {
+      printf("Most solutions to look for? (0 for all of them)\n");
+      int max;
+      int er = scanf("%d", &max);
+      while(ch = getchar() != '\n'){}
+      if (er < 1 || max < 0) {
+	printf("Invalid count. Keeping the current one.\n");
+	continue;
+      }
+      opts.limit = max;
+    } else if (strcmp("p", buffer) == 0 || strcmp("split", buffer) == 0) {
+      printf("Jobs per thread before solving? (0 to start from the whole board)\n");
+      int per;
+      int er = scanf("%d", &per);
+      while(ch = getchar() != '\n'){}
+      if (er < 1 || per < 0) {
+	printf("Invalid count. Keeping the current one.\n");
+	continue;
+      }
+      opts.split = per;
+      printf("Re-split large jobs when a thread runs out of work? (yes/no)\n");
+      i = 0;
+      while (i < sizeof(buffer) - 1 && (ch = getchar()) != '\n' && ch != EOF)
+	buffer[i++] = ch;
+      buffer[i] = 0;
+      opts.resplit = strcmp("yes", buffer) == 0;
+    } else if (strcmp("r", buffer) == 0 || strcmp("run", buffer) == 0) {
+      if (s == NULL) {
+	printf("No sudoku available. Please import/make a sudoku first.\n");
+	continue;
+      }
+      printf("Use threads? (yes/no)\n");
+      i = 0;
+      while (i < sizeof(buffer) - 1 && (ch = getchar()) != '\n' && ch != EOF)
+	buffer[i++] = ch;
+      buffer[i] = 0;
+      if (strcmp("yes", buffer) == 0) {
+	printf("How many?\n");
+	int nt;
+	int er = scanf("%d", &nt);
+	while(ch = getchar() != '\n'){}
+	if (er < 1 || nt < 1) {
+	  printf("Invalid size. Aborting import.\n");
+	  continue;
+	}
+	if (streamPath[0] != 0) {
+	  FILE* out = fopen(streamPath, "w");
+	  if (out == NULL) {
+	    printf("Cannot write to that file. Aborting.\n");
+	    continue;
+	  }
+	  SolutionWriter wr;
+	  initWriter(&wr, out);
+	  Options streaming = opts;
+	  streaming.sink = &wr.sink;
+	  Report r = solveSudokuThreads(s, nt, &streaming);
+	  freeWriter(&wr);
+	  fclose(out);
+	  printf("Success! Wrote %ld solutions.\n", r.count);
+	  freeReport(&r);
+	  continue;
+	}
+	Report r = solveSudokuThreads(s, nt, &opts);
+	printf("Success! There are %ld solutions.\n", r.count);
+	printf("View solutions? (yes/no)\n");
+	i = 0;
+	while (i < sizeof(buffer) - 1 && (ch = getchar()) != '\n' && ch != EOF)
+	  buffer[i++] = ch;
+	buffer[i] = 0;
+	if (strcmp("yes", buffer) == 0) {
+	  for (int i = 0; i < r.solutions->numSols; i++) {
+	    printSudoku(r.solutions->solutions[i]);
+	  } 
+	}
+	freeReport(&r);
+      } else if (strcmp("no", buffer) == 0) {
+	// Serial runs only report how many there are
+	Options counting = opts;
+	counting.countOnly = 1;
+	Report r = solveSudoku(s, &counting);
+	printf("There were %ld solutions found.\n", r.count);
+	freeReport(&r);
+      } else {
+	printf("Not a yes/no. Aborting.\n");
+      }
+    } else {
+      printf("Invalid command. Please try again.\n");
+    }
+  }
+  return 0;
+}
+
+// Command-line Driver
+
+void printUsage(FILE* f) {
+  fprintf(f, "usage: solver [-i file] [options]\n");
+  fprintf(f, "  with no arguments, starts the interactive prompt\n");
+  fprintf(f, "  -i file     puzzle file, or - for standard input\n");
+  fprintf(f, "  -n size     puzzle size (default 9)\n");
+  fprintf(f, "  -t threads  worker threads; 1 runs the serial solver (default 1)\n");
+  fprintf(f, "  -l limit    stop after this many solutions, 0 for all (default 0)\n");
+  fprintf(f, "  -f format   text, json or csv (default text)\n");
+  fprintf(f, "  -b branch   first, mrv or degree (default mrv)\n");
+  fprintf(f, "  -u undo     auto, trail or snapshot (default auto: snapshot up to 9x9)\n");
+  fprintf(f, "  -s subsets  largest naked/hidden subset, 0 to disable (default 2)\n");
+  fprintf(f, "  -p split    jobs per thread before solving, 0 for one (default 4)\n");
+  fprintf(f, "  -r          never re-split jobs while solving\n");
+  fprintf(f, "  -q          count solutions without keeping them\n");
+  fprintf(f, "  -o file     write solutions to file as they are found, one line\n");
+  fprintf(f, "              each (- for standard output, which moves the report\n");
+  fprintf(f, "              to standard error)\n");
+  fprintf(f, "  -T seconds  time budget, per puzzle with -B (default none)\n");
+  fprintf(f, "  -N guesses  node budget (default none)\n");
+  fprintf(f, "  -M entries  trail budget per thread (default none)\n");
+  fprintf(f, "  -B          solve every puzzle in the file, one solution line each\n");
+  fprintf(f, "              (with -q, each puzzle's solution count instead)\n");
+  fprintf(f, "  -P          with -B, write solutions as a packed file\n");
+  fprintf(f, "  -C          convert every puzzle in the file to a packed file\n");
+  fprintf(f, "  -B and -C write to standard output unless -o names a file. Packed\n");
+  fprintf(f, "  files are recognized as input by their header.\n");
+}
+
+void printReport(FILE* f, const Report* r, int sz, int nt, int format, int quiet) {
+  Solutions* sols = r->solutions;
+  int shown = sols->numSols;
+  if (format == FORMAT_JSON) {
+    fprintf(f, "{\"size\": %d, \"threads\": %d, \"solutions\": %ld, \"nodes\": %ld, \"jobs\": %d, \"seconds\": %.6f, \"stopped\": \"%s\", \"complete\": %s, \"frontier\": %ld",
+	   sz, nt, r->count, r->nodes, r->jobs, r->secs, stopNames[r->stopped], r->complete ? "true" : "false", r->frontier);
+    if (!quiet) {
+      fprintf(f, ", \"grids\": [");
+      for (int i = 0; i < shown; i++) {
+	char* text = formatSudoku(sols->solutions[i]);
+	fprintf(f, i == 0 ? "\"%s\"" : ", \"%s\"", text);
+	free(text);
+      }
+      fprintf(f, "]");
+    }
+#ifdef SOLVER_STATS
+    printStats(f, &r->stats, FORMAT_JSON);
+#endif
+    fprintf(f, "}\n");
+  } else if (format == FORMAT_CSV) {
+    // One row per solution, so every row carries the run's figures
+    fprintf(f, "size,threads,solutions,nodes,jobs,seconds,stopped,complete,frontier,");
+#ifdef SOLVER_STATS
+    fprintf(f, "statNodes,backtracks,singles,hiddenSingles,subsetElims,passes,trailPeak,singlesSecs,hiddenSecs,subsetsSecs,");
+#endif
+    fprintf(f, "grid\n");
+    for (int i = 0; i == 0 || i < shown; i++) {
+      char* text = i < shown ? formatSudoku(sols->solutions[i]) : NULL;
+      fprintf(f, "%d,%d,%ld,%ld,%d,%.6f,%s,%d,%ld,", sz, nt, r->count, r->nodes, r->jobs, r->secs,
+	     stopNames[r->stopped], r->complete, r->frontier);
+#ifdef SOLVER_STATS
+      printStats(f, &r->stats, FORMAT_CSV);
+      fprintf(f, ",");
+#endif
+      fprintf(f, "%s\n", text == NULL ? "" : text);
+      free(text);
+    }
+  } else {
+    fprintf(f, "There were %ld solutions found.\n", r->count);
+    fprintf(f, "Made %ld guesses over %d jobs in %.6f seconds.\n", r->nodes, r->jobs, r->secs);
+    if (!r->complete)
+      fprintf(f, "Stopped early (%s) with %ld subtrees unexplored.\n", stopNames[r->stopped], r->frontier);
+#ifdef SOLVER_STATS
+    printStats(f, &r->stats, FORMAT_TEXT);
+#endif
+    for (int i = 0; i < shown; i++) {
+      printSudoku(sols->solutions[i]);
+    }
+  }
+}
+
+int runDriver(int argc, char* argv[]) {
+  Options opts = DEFAULT_OPTIONS;
+  char* path = NULL;
+  char* outPath = NULL;
+  int sz = 9, nt = 1, format = FORMAT_TEXT, quiet = 0, batch = 0, packed = 0, convert = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "i:n:t:l:f:b:u:s:p:rqo:T:N:M:BPCh")) != -1) {
+    switch (opt) {
+    case 'i':
+      path = optarg;
+      break;
+    case 'n':
+      sz = atoi(optarg);
+      break;
+    case 't':
+      nt = atoi(optarg);
+      break;
+    case 'l':
+      opts.limit = atoi(optarg);
+      break;
+    case 'f':
+      if (strcmp("text", optarg) == 0)
+	format = FORMAT_TEXT;
+      else if (strcmp("json", optarg) == 0)
+	format = FORMAT_JSON;
+      else if (strcmp("csv", optarg) == 0)
+	format = FORMAT_CSV;
+      else
+	format = -1;
+      break;
+    case 'b':
+      if (strcmp("first", optarg) == 0)
+	opts.branch = BRANCH_FIRST;
+      else if (strcmp("mrv", optarg) == 0)
+	opts.branch = BRANCH_MRV;
+      else if (strcmp("degree", optarg) == 0)
+	opts.branch = BRANCH_MRV_DEGREE;
+      else
+	opts.branch = -1;
+      break;
+    case 'u':
+      if (strcmp("auto", optarg) == 0)
+	opts.undo = UNDO_AUTO;
+      else if (strcmp("trail", optarg) == 0)
+	opts.undo = UNDO_TRAIL;
+      else if (strcmp("snapshot", optarg) == 0)
+	opts.undo = UNDO_SNAPSHOT;
+      else
+	opts.undo = -1;
+      break;
+    case 's':
+      opts.subsets = atoi(optarg);
+      break;
+    case 'p':
+      opts.split = atoi(optarg);
+      break;
+    case 'r':
+      opts.resplit = 0;
+      break;
+    case 'q':
+      quiet = 1;
+      opts.countOnly = 1;
+      break;
+    case 'o':
+      outPath = optarg;
+      break;
+    case 'T':
+      opts.maxSecs = atof(optarg);
+      break;
+    case 'N':
+      opts.maxNodes = atol(optarg);
+      break;
+    case 'M':
+      opts.maxTrail = atoi(optarg);
+      break;
+    case 'B':
+      batch = 1;
+      break;
+    case 'P':
+      packed = 1;
+      break;
+    case 'C':
+      convert = 1;
+      break;
+    case 'h':
+      printUsage(stdout);
+      return 0;
+    default:
+      printUsage(stderr);
+      return 2;
+    }
+  }
+  if (path == NULL || optind != argc || sz < 4 || sz > MAX_SIZE || sqrt(sz) * sqrt(sz) != sz
+      || nt < 1 || opts.limit < 0 || format < 0 || opts.branch < 0 || opts.undo < 0 || opts.subsets < 0 || opts.split < 0
+      || opts.maxSecs < 0 || opts.maxNodes < 0 || opts.maxTrail < 0 || (packed && (!batch || opts.countOnly))
+      || (convert && batch)) {
+    printUsage(stderr);
+    return 2;
+  }
+
+  FILE* in = strcmp("-", path) == 0 ? stdin : fopen(path, "r");
+  if (in == NULL) {
+    fprintf(stderr, "solver: cannot open %s\n", path);
+    return 1;
+  }
+  CancelToken cancel;
+  initCancel(&cancel, 0);
+  opts.cancel = &cancel;
+  interrupted = &cancel;
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = onInterrupt;
+  sigaction(SIGINT, &sa, NULL);
+
+  int status = 0;
+  if (batch || convert) {
+    FILE* out = outPath == NULL || strcmp("-", outPath) == 0 ? stdout : fopen(outPath, "w");
+    if (out == NULL) {
+      fprintf(stderr, "solver: cannot write %s\n", outPath);
+      status = 1;
+    } else if (convert) {
+      long count = packPuzzles(in, out, sz);
+      if (count < 0) {
+	fprintf(stderr, "solver: bad packed header in %s\n", path);
+	status = 1;
+      } else {
+	fprintf(stderr, "Packed %ld puzzles.\n", count);
+      }
+    } else {
+      // Solutions go to the output, the summary to standard error
+      BatchStats st = solveBatch(in, out, sz, nt, &opts, packed);
+      if (st.badInput) {
+	fprintf(stderr, "solver: bad packed header in %s\n", path);
+	status = 1;
+      } else {
+	printBatchStats(stderr, &st, format);
+      }
+    }
+    if (out != NULL && out != stdout)
+      fclose(out);
+  } else {
+    PuzzleReader rd;
+    int valid = initReader(&rd, in, sz);
+    Sudoku* s = NULL;
+    BoardPool* pool = makePool();
+    int er = readPuzzle(&rd, pool, &s);
+    freePool(pool);
+    if (!valid) {
+      fprintf(stderr, "solver: bad packed header in %s\n", path);
+      status = 1;
+    } else if (er != 1) {
+      fprintf(stderr, "solver: no valid puzzle in %s\n", path);
+      status = 1;
+    } else {
+      // Streamed solutions are never held, so the report only counts them
+      FILE* out = NULL;
+      SolutionWriter wr;
+      if (outPath != NULL) {
+	out = strcmp("-", outPath) == 0 ? stdout : fopen(outPath, "w");
+	if (out == NULL) {
+	  fprintf(stderr, "solver: cannot write %s\n", outPath);
+	  freeSudoku(s);
+	  freeReader(&rd);
+	  if (in != stdin)
+	    fclose(in);
+	  return 1;
+	}
+	initWriter(&wr, out);
+	opts.sink = &wr.sink;
+	quiet = 1;
+      }
+      Report r = nt == 1 ? solveSudoku(s, &opts) : solveSudokuThreads(s, nt, &opts);
+      if (out != NULL) {
+	freeWriter(&wr);
+	if (out != stdout)
+	  fclose(out);
+      }
+      printReport(out == stdout ? stderr : stdout, &r, sz, nt, format, quiet);
+      freeReport(&r);
+      freeSudoku(s);
+    }
+    freeReader(&rd);
+  }
+  if (in != stdin)
+    fclose(in);
+  return status;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc == 1)
+    return runRepl();
+  return runDriver(argc, argv);
+}
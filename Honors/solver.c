@@ -1,663 +1,732 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
 #include <string.h>
+#include <time.h>
+#include <sched.h>
 #include <pthread.h>
 #include "cells.h"
 #include "trail.h"
 #include "sudoku.h"
+#include "kernels.h"
+#include "stats.h"
 #include "solver.h"
 
 // Sudoku Scanning
 
-int findSingleton(Cell* c, int sz) {
-  // Assumes singleton already exists
-  for (int i = 1; i <= sz; i++) {
-    if (c->gs[i] == 1) {
-      return i;
-    }
+int scanSudoku(Sudoku* s, Trail* t, int maxSubset) {
+  return s->kn->scan(s, t, maxSubset);
+}
+
+// Sudoku Guessing
+int makeGuess(Marks* m, Trail* t, Sudoku* s, int ID, int guess) {
+  addMark(m, t->sz, ID, guess, s->ngs[ID] > 1);
+  enterLevel(t);
+  return setCellByID(s, guess, ID, t);
+}
+
+int removeGuessT(Sudoku* s, int id, int n, Trail* t) {
+  return s->kn->removeGuess(s, id, n, t);
+}
+
+// Snapshot mode logs nothing: the board is copied before each guess, so
+// undoing any number of levels is a single copy back
+int makeGuessSnap(Marks* m, Snapshots* sn, Sudoku* s, int ID, int guess) {
+  addMark(m, sn->sz, ID, guess, s->ngs[ID] > 1);
+  pushSnapshot(sn, s);
+  return setCellByID(s, guess, ID, NULL);
+}
+
+int chainRestoreSnap(Marks* m, Snapshots* sn, Sudoku* s, int undos) {
+  int k = m->sz - 1;
+  while (k >= 0 && !m->marks[k].open)
+    k--;
+  STAT_ADD(backtracks, m->sz - (k < 0 ? 0 : k));
+  if (k < 0) {
+    m->sz = 0;
+    return -1;
   }
-  //printf("FATAL ERROR at: findSingleton() for cell %d", c->id);
-  return -1;
-}
-
-int findSingletons(Sudoku* s, Trail* t) {
-  int singletons = 0;
-  for (int i = 0; i < s->sz * s->sz; i++) {
-    if (s->cs[i]->val == 0 && s->cs[i]->ngs == 1) {
-      singletons++;
-      int digit = findSingleton(s->cs[i], s->sz);
-      int error;
-
-      if (digit == -1)
-	return -2;
-      error = setCellByID(s, digit, i, t);
-      switch (error) {
-      case 1: 
-	break;
-      case -2:
-	return -1;
-      default:
-	//printf("FATAL ERROR at: findSingletons() due to impossible error with id %d\n", error);
-	return -1;
-      }
-    }
+  undos += m->sz - k - 1;
+  Mark mark = m->marks[k];
+  m->sz = k;
+  copySudokuInto(s, getSnapshot(sn, mark.index));
+  sn->sz = mark.index;
+  removeGuessT(s, mark.cell, mark.guess, NULL);
+  return undos;
+}
+
+int findGuessCell(Sudoku* s, int branch) {
+  return s->kn->findGuessCell(s, branch);
+}
+
+int findGuess(Sudoku* s, int id) {
+  return maskFirst(cellGuesses(s, id), s->nw);
+}
+
+void rewindSudoku(Sudoku* s, Trail* t, int to) {
+  s->kn->rewind(s, t, to);
+}
+
+int chainRestore(Marks* m, Trail* t, Sudoku* s, int undos) {
+  return s->kn->chainRestore(m, t, s, undos);
+}
+
+// Thread Object Manipulation
+
+Solutions* makeSStack() {
+  Solutions* s = (Solutions*)malloc(sizeof(Solutions));
+  s->numSols = 0;
+  s->maxSols = 1;
+  s->held = 0;
+
+  Sudoku** solutions = (Sudoku**)malloc(sizeof(Sudoku*) * s->maxSols);
+  s->solutions = solutions;
+  return s; 
+}
+
+void reallocSStack(Solutions* s) {
+  s->maxSols *= 2;
+  s->solutions = (Sudoku**)realloc(s->solutions, sizeof(Sudoku*) * s->maxSols);
+}
+
+// Copies b in, over a board an earlier clear kept if it is the same size
+static void pushSolution(Solutions* s, Sudoku* b) {
+  int i = s->numSols++;
+  if (i < s->held && s->solutions[i]->bytes == b->bytes) {
+    copySudokuInto(s->solutions[i], b);
+    return;
   }
-  return singletons;
-}
-int findHiddenSinglesGroup(Sudoku* s, Group* g, Trail* t) {
-  // -1 not found, >=0 sole instance, -2 multiple instances
-  int firstInstances[s->sz + 1];
-  for (int k = 1; k <= s->sz; k++)
-    firstInstances[k] = -1;
-  for (int i = 0; i < g->ncs; i++) {
-    Cell* c = g->cs[i];
-    for (int j = 1; j <= s->sz; j++) {
-      if (c->gs[j] == 1) {
-	if (firstInstances[j] == -1) {
-	  firstInstances[j] = c->id;
-	} else if (firstInstances[j] >= 0) {
-	  firstInstances[j] = -2;
-	}
-      }
-    }
+  if (i < s->held) {
+    freeSudoku(s->solutions[i]);
+  } else {
+    if (s->held == s->maxSols)
+      reallocSStack(s);
+    s->held++;
   }
+  s->solutions[i] = copySudoku(b);
+}
 
-  int noHS = 0;
-  int error;
+// Empties the stack but keeps its boards for the next solutions
+void clearSStack(Solutions* s) {
+  s->numSols = 0;
+}
 
-  for (int m = 1; m <= s->sz; m++) {
-    if (firstInstances[m] >= 0) {
-      noHS++;
-      error = setCellByID(s, m, firstInstances[m], t);
-      if (error != 1) {
-	return -1;
-      }
-    }
-  }
-  return noHS;
-}
-int findHiddenSingles(Sudoku* s, Trail* t) {
-  int noHS = 0;
-  for (int i = 0; i < s->sz; i++) {
-    Group* row = getFilteredRow(s, i);
-    Group* col = getFilteredCol(s, i);
-    Group* box = getFilteredBox(s, i);
-
-    int rowHS = findHiddenSinglesGroup(s, row, t);
-    free(row);
-    int colHS = findHiddenSinglesGroup(s, col, t);
-    free(col);
-    int boxHS = findHiddenSinglesGroup(s, box, t);
-    free(box);
-
-    if (rowHS == -1 || colHS == -1 || boxHS == -1)
-      return -1;
-    noHS += rowHS + colHS + boxHS; 
+void freeSStack(Solutions* s) {
+  for (int i = 0; i < s->held; i++) {
+    freeSudoku(s->solutions[i]);
   }
-  return noHS;
+  free(s->solutions);
+  free(s);
 }
 
-int findPreemptiveSetAux(Sudoku* s, Group* g, int curr, int noin, int inIDs[], int nogs, int gs[], Trail* t) {
-  if (curr == g->ncs) {
-    return 0;
+static JobArray* makeJobArray(long size, JobArray* prev) {
+  JobArray* a = (JobArray*)malloc(sizeof(JobArray) + sizeof(Job) * size);
+  a->size = size;
+  a->prev = prev;
+  return a;
+}
+
+static void initDeque(Deque* d) {
+  d->top = 0;
+  d->bottom = 0;
+  d->array = makeJobArray(DEQUE_START, NULL);
+}
+
+static void freeDeque(Deque* d) {
+  JobArray* a = d->array;
+  while (a != NULL) {
+    JobArray* prev = a->prev;
+    free(a);
+    a = prev;
   }
+}
 
-  Cell* c = g->cs[curr];
-  int newnoin = noin;
-  int newinIDs[g->ncs];
-  for (int x = 0; x < g->ncs; x++)
-    newinIDs[x] = inIDs[x];
-  int newnogs = nogs;
-  int newgs[s->sz + 1];
-  for (int y = 1; y <= s->sz; y++)
-    newgs[y] = gs[y]; 
-
-  newnoin++;
-  newinIDs[curr] = 1;
-  for (int i = 1; i <= s->sz; i++) {
-    if (c->gs[i] == 1 && newgs[i] == 0) {
-      newgs[i] = 1;
-      newnogs++;
-    }
+// A slot may be written by the owner while a thief that is about to lose
+// its race for it reads it, so both sides go through atomics
+static void putSlot(JobArray* a, long i, Job j) {
+  Job* slot = &a->jobs[i & (a->size - 1)];
+  __atomic_store_n(&slot->s, j.s, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->depth, j.depth, __ATOMIC_RELAXED);
+}
+
+static Job getSlot(JobArray* a, long i) {
+  Job* slot = &a->jobs[i & (a->size - 1)];
+  Job j = {__atomic_load_n(&slot->s, __ATOMIC_RELAXED), __atomic_load_n(&slot->depth, __ATOMIC_RELAXED)};
+  return j;
+}
+
+// Owner only
+static void pushJob(Deque* d, Job j) {
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  JobArray* a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+  if (b - t == a->size) {
+    JobArray* bigger = makeJobArray(a->size * 2, a);
+    for (long i = t; i < b; i++)
+      putSlot(bigger, i, getSlot(a, i));
+    __atomic_store_n(&d->array, bigger, __ATOMIC_RELEASE);
+    a = bigger;
   }
-  if (newnogs < newnoin) {
-    //printf("Error: number of guesses cannot be smaller than cells\n");
-    return -1;
-  } else if (newnoin == newnogs) {
-    int removed = 0;
-    for (int j = 0; j < g->ncs; j++) {
-      for (int k = 1; k <= s->sz; k++) {
-	if (newinIDs[j] == 0 && newgs[k] == 1 && g->cs[j]->gs[k] == 1) {
-	  removed++;
-	  int remgs = removeGuessT(g->cs[j], k, t);
-	  if (remgs == 0) {
-	    //printf("Error: no more remaining guesses for cell with id %d\n", g->cs[j]->id);
-	    return -1;
-	  }
-	}
-      }
+  putSlot(a, b, j);
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+// Owner end: the newest job, which shares the most state with the last one.
+// Only a deque's last job is raced for.
+static int popJob(Deque* d, Job* j) {
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+  JobArray* a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+  __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+  int found = t <= b;
+  if (found) {
+    *j = getSlot(a, b);
+    if (t == b) {
+      found = __atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+      __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
     }
-    return removed;
   } else {
-    int include = findPreemptiveSetAux(s, g, curr + 1, newnoin, newinIDs, newnogs, newgs, t);
-    int exclude = findPreemptiveSetAux(s, g, curr + 1, noin, inIDs, nogs, gs, t);
-
-    if (include == -1 || exclude == -1)
-      return -1;
-    return include + exclude;
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
   }
+  return found;
 }
 
-int findPreemptiveSet(Sudoku* s, Group* g, Trail* t) {
-  int inIDs[g->ncs];
-  for (int i = 0; i < g->ncs; i++)
-    inIDs[i] = 0;
-  int gs[s->sz + 1];
-  for (int j = 1; j <= s->sz; j++)
-    gs[j] = 0; 
-  return findPreemptiveSetAux(s, g, 0, 0, inIDs, 0, gs, t);
-}
-
-int findPreemptiveSets(Sudoku* s, Trail* t) {
-  int removed = 0;
-  for (int i = 0; i < s->sz; i++) {
-    Group* row = getFilteredRow(s, i);
-    Group* col = getFilteredCol(s, i);
-    Group* box = getFilteredBox(s, i);
-
-    int rowR = findPreemptiveSet(s, row, t);
-    free(row);
-    int colR = findPreemptiveSet(s, col, t);
-    free(col);
-    int boxR = findPreemptiveSet(s, box, t);
-    free(box);
-    if (rowR == -1 || colR == -1 || boxR == -1)
-      return -1;  
-    removed += rowR + colR + boxR; 
-  }
-  return removed;  
-}
-
-int scanSudoku(Sudoku* s, Trail* t) {
-  //printf("Starting new scan!\n");
-  int singletons = 0, HS = 0, removed = 0;
-  do {
-    //printf("SINGLETONS\n");
-    singletons = findSingletons(s, t);
-    //printf("HIDDEN SINGLES\n");
-    HS = findHiddenSingles(s, t);
-    //printf("PREEMPTIVE SETS\n");
-    removed = findPreemptiveSets(s, t);
-    //printSudoku(s);
-    //printf("singletons: %d HS: %d removed: %d\n", singletons, HS, removed);
-  } while ((singletons > 0 || HS > 0 || removed > 0) && (singletons != -1 && HS != -1 && removed != -1));
-
-  if (singletons < 0 || HS < 0 || removed < 0) {
-    return -1;
-  } else
+// Thief end: the oldest job, which is the biggest subtree on offer. Fails
+// if another thread takes it first.
+static int stealJob(Deque* d, Job* j) {
+  long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+  if (t >= b)
     return 0;
+  JobArray* a = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+  Job x = getSlot(a, t);
+  if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return 0;
+  *j = x;
+  return 1;
 }
 
-// Sudoku Guessing
-void makeGuess(Marks* m, Trail* t, Sudoku* s, int ID, int guess) {
-  //printf("Making guess %d for cell %d\n", guess, ID);
-  //printCell(s->cs[ID], s->sz);
-  addMark(m, t->sz);
-  setCellByID(s, guess, ID, t);
+static long dequeSize(Deque* d) {
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+  return b > t ? b - t : 0;
 }
 
-int findGuessCell(Sudoku* s) {
-  for(int i = 0; i < s->sz * s->sz; i++) {
-    if (s->cs[i]->ngs > 0) {
-      return i;
-    }
+// Search State
+
+void initShared(SharedInfo* shr, int nt, const Options* o) {
+  shr->pending = 0;
+  shr->hungry = 0;
+  initCancel(&shr->stop, o->maxSecs);
+  shr->found = 0;
+  shr->spent = 0;
+  shr->frontier = 0;
+  memset(&shr->stats, 0, sizeof(Stats));
+  shr->jobsDone = 0;
+  shr->jobNodes = 0;
+  shr->numThreads = nt;
+  void* deques;
+  posix_memalign(&deques, CACHE_LINE, sizeof(Deque) * nt);
+  shr->deques = deques;
+  for (int i = 0; i < nt; i++)
+    initDeque(&shr->deques[i]);
+  shr->solutions = makeSStack();
+  shr->opts = o;
+  pthread_mutex_init(&shr->mtx, NULL);
+  shr->parked = 0;
+  pthread_mutex_init(&shr->parkMtx, NULL);
+  pthread_cond_init(&shr->park, NULL);
+}
+
+// Forgets the last solve's solutions and counts so shr can be used again
+void resetShared(SharedInfo* shr) {
+  clearSStack(shr->solutions);
+  initCancel(&shr->stop, shr->opts->maxSecs);
+  shr->found = 0;
+  shr->spent = 0;
+  shr->frontier = 0;
+  memset(&shr->stats, 0, sizeof(Stats));
+  shr->jobsDone = 0;
+  shr->jobNodes = 0;
+}
+
+// Leaves shr->solutions alone; whoever reports them frees them
+void freeShared(SharedInfo* shr) {
+  for (int i = 0; i < shr->numThreads; i++)
+    freeDeque(&shr->deques[i]);
+  free(shr->deques);
+  pthread_mutex_destroy(&shr->mtx);
+  pthread_mutex_destroy(&shr->parkMtx);
+  pthread_cond_destroy(&shr->park);
+}
+
+void initWorker(ThreadInfo* w, int id, SharedInfo* shr) {
+  w->id = id;
+  w->nodes = 0;
+  w->found = 0;
+  w->polled = 0;
+  w->nextPoll = 0;
+  w->snap = 0;
+  w->t = makeTrail();
+  w->sn = makeSnapshots();
+  w->m = createMarks();
+  w->pool = makePool();
+  w->SI = shr;
+}
+
+void freeWorker(ThreadInfo* w) {
+  freeTrail(w->t);
+  freeSnapshots(w->sn);
+  freeMarks(w->m);
+  freePool(w->pool);
+}
+
+double wallClock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Search Statistics
+
+#ifdef SOLVER_STATS
+__thread Stats threadStats;
+#endif
+
+void mergeStats(Stats* into, const Stats* from) {
+  into->nodes += from->nodes;
+  into->backtracks += from->backtracks;
+  into->singles += from->singles;
+  into->hiddenSingles += from->hiddenSingles;
+  into->subsetElims += from->subsetElims;
+  into->passes += from->passes;
+  if (from->trailPeak > into->trailPeak)
+    into->trailPeak = from->trailPeak;
+  for (int i = 0; i < NUM_RULES; i++)
+    into->ruleSecs[i] += from->ruleSecs[i];
+}
+
+// Moves this thread's counts into the solve's totals
+static void flushStats(SharedInfo* shr) {
+#ifdef SOLVER_STATS
+  pthread_mutex_lock(&shr->mtx);
+  mergeStats(&shr->stats, &threadStats);
+  pthread_mutex_unlock(&shr->mtx);
+  memset(&threadStats, 0, sizeof(Stats));
+#endif
+}
+
+// Solution Sinks
+
+static void writeSolution(void* ctx, Sudoku* s) {
+  SolutionWriter* wr = ctx;
+  char* text = formatSudoku(s);
+  pthread_mutex_lock(&wr->mtx);
+  fputs(text, wr->out);
+  fputc('\n', wr->out);
+  // Someone is waiting on the first one; after that, batch them up
+  double now = wallClock();
+  if (wr->written++ == 0 || now - wr->flushed >= WRITER_FLUSH_SECS) {
+    fflush(wr->out);
+    wr->flushed = now;
   }
-  return -1;
+  pthread_mutex_unlock(&wr->mtx);
+  free(text);
+}
+
+void initWriter(SolutionWriter* wr, FILE* out) {
+  wr->sink.emit = writeSolution;
+  wr->sink.ctx = wr;
+  wr->out = out;
+  wr->written = 0;
+  wr->flushed = 0;
+  pthread_mutex_init(&wr->mtx, NULL);
+}
+
+// Flushes what is left; the file stays open
+void freeWriter(SolutionWriter* wr) {
+  fflush(wr->out);
+  pthread_mutex_destroy(&wr->mtx);
 }
 
-int findGuess(Cell* c, int sz) {
-  for (int i = 1; i <= sz; i++) {
-    if (c->gs[i] == 1) {
-      return i;
+// Cancellation
+
+// timeout is in seconds from now, 0 for no deadline
+void initCancel(CancelToken* c, double timeout) {
+  c->reason = STOP_NONE;
+  c->deadline = timeout > 0 ? wallClock() + timeout : 0;
+}
+
+void cancelSearch(CancelToken* c, int reason) {
+  int none = STOP_NONE;
+  __atomic_compare_exchange_n(&c->reason, &none, reason, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+// Returns why c was cancelled, or STOP_NONE. Reading the clock costs more
+// than a guess, which is why searches only call this every CANCEL_POLL.
+int checkCancel(CancelToken* c) {
+  if (__atomic_load_n(&c->reason, __ATOMIC_RELAXED) == STOP_NONE && c->deadline > 0
+      && wallClock() >= c->deadline)
+    cancelSearch(c, STOP_DEADLINE);
+  return __atomic_load_n(&c->reason, __ATOMIC_RELAXED);
+}
+
+// Workers only read shr->stop between polls
+static int stopped(SharedInfo* shr) {
+  return __atomic_load_n(&shr->stop.reason, __ATOMIC_RELAXED) != STOP_NONE;
+}
+
+// Brings shr->stop up to date: charges w's guesses since its last poll to
+// the node budget, checks the time budget, and copies in the caller's token.
+// Polls come every CANCEL_POLL guesses, or sooner as the node budget runs
+// out, so a single worker stops right on it and several only a little past.
+static int pollStop(SharedInfo* shr, ThreadInfo* w) {
+  const Options* o = shr->opts;
+  if (w != NULL) {
+    long spent = __atomic_add_fetch(&shr->spent, w->nodes - w->polled, __ATOMIC_RELAXED);
+    long step = CANCEL_POLL;
+    w->polled = w->nodes;
+    if (o->maxNodes > 0) {
+      if (spent >= o->maxNodes)
+	cancelSearch(&shr->stop, STOP_NODES);
+      else if ((o->maxNodes - spent) / shr->numThreads < step)
+	step = (o->maxNodes - spent) / shr->numThreads + 1;
     }
+    w->nextPoll = w->nodes + step;
   }
-  return -1;
-}
-
-void restore(Marks* m, Trail* t, Sudoku* s) {
-  int mark = extractMark(m);
-  while (t->sz != mark) {
-    Data change = extractChange(t);
-    if (change.type == 1) {
-      s->cs[change.cellID]->val = 0;
-      s->rem++;
-    } else {
-      if (s->cs[change.cellID]->gs[change.value] == 0) {
-	s->cs[change.cellID]->gs[change.value] = 1;
-	s->cs[change.cellID]->ngs++;
-      }
-    }
+  checkCancel(&shr->stop);
+  if (o->cancel != NULL) {
+    int reason = checkCancel(o->cancel);
+    if (reason != STOP_NONE)
+      cancelSearch(&shr->stop, reason);
   }
+  return stopped(shr);
 }
 
-int chainRestore(Marks* m, Trail* t, Sudoku* s, int undos) {
-  //printf("Starting chain restore.\n");
-  //printf("ORIGINAL:\n");
-  //printSudoku(s);
-  restore(m, t, s);
-  //printf("RESTORED:\n");
-  //printSudoku(s);
-
-  int guessID = findGuessCell(s);
-  if (guessID == -1) {
-    return -1;
-  }
-  int guess = findGuess(s->cs[guessID], s->sz);
-  //printCell(s->cs[guessID], s->sz);
-  if (s->cs[guessID]->ngs == 1) {
-    if (m->sz == 0) {
-      return -1;
-    } else {
-      return chainRestore(m, t, s, undos + 1);
+// Work Sharing
+
+// Counts a solution, and hands it to the sink or keeps a copy of it unless
+// only counts are wanted.
+// Without a limit, workers count in their own ThreadInfo and the totals are
+// merged as jobs finish. A limit needs a running total everyone can see, so
+// each solution is counted there instead; once it is reached this returns
+// 0 and every other worker is told to stop.
+static int addSolution(SharedInfo* shr, ThreadInfo* w, Sudoku* s) {
+  const Options* o = shr->opts;
+  int more = 1;
+  if (o->limit > 0) {
+    long n = __atomic_add_fetch(&shr->found, 1, __ATOMIC_SEQ_CST);
+    if (n >= o->limit) {
+      cancelSearch(&shr->stop, STOP_LIMIT);
+      more = 0;
+      // Others can pass the limit before they see the stop
+      if (n > o->limit)
+	return 0;
     }
+  } else if (w != NULL) {
+    w->found++;
   } else {
-    //printf("removing guess %d\n", guess);
-    if (m->sz == 0) {
-      removeGuessT(s->cs[guessID], guess, NULL);
-      return undos;
-    }
-    removeGuessT(s->cs[guessID], guess, t);
-    return undos;
+    __atomic_add_fetch(&shr->found, 1, __ATOMIC_RELAXED);
+  }
+  if (o->sink != NULL) {
+    o->sink->emit(o->sink->ctx, s);
+  } else if (!o->countOnly) {
+    pthread_mutex_lock(&shr->mtx);
+    pushSolution(shr->solutions, s);
+    pthread_mutex_unlock(&shr->mtx);
   }
+  return more;
 }
 
-// Sudoku Solving
-
-void solveSudoku(Sudoku* s) {
-  Trail* t = makeTrail();
-  Marks* m = createMarks();
-
-  int scanEr, restEr, solutions = 0;
-  scanEr = scanSudoku(s, NULL);
-  //printSudoku(s);
-  if (scanEr == -1) {
-    //printf("Sudoku cannot be solved.\n");
-    freeTrail(t);
-    freeMarks(m);
+// Hands the shallowest untried alternative of the current search to an idle
+// worker. The job is the board as it stood at that guess, minus the guess,
+// and the alternative is closed so this worker never backtracks into it.
+static void offerWork(ThreadInfo* w, Sudoku* s) {
+  SharedInfo* shr = w->SI;
+  if (!shr->opts->resplit || __atomic_load_n(&shr->hungry, __ATOMIC_RELAXED) == 0 || stopped(shr))
+    return;
+  // Jobs smaller than the ones seen so far will be over soon; only split
+  // one that has already outgrown the average
+  int done = __atomic_load_n(&shr->jobsDone, __ATOMIC_RELAXED);
+  if (done > 0 && w->nodes * done < __atomic_load_n(&shr->jobNodes, __ATOMIC_RELAXED))
+    return;
+  Deque* d = &shr->deques[w->id];
+  if (dequeSize(d) > 0)
     return;
+  Marks* m = w->m;
+  int k = 0;
+  while (k < m->sz && !m->marks[k].open)
+    k++;
+  if (k == m->sz)
+    return;
+  Mark* mark = &m->marks[k];
+  Sudoku* copy;
+  if (w->snap) {
+    copy = takeCopy(w->pool, getSnapshot(w->sn, mark->index));
+  } else {
+    copy = takeCopy(w->pool, s);
+    rewindSudoku(copy, w->t, mark->index);
+  }
+  removeGuessT(copy, mark->cell, mark->guess, NULL);
+  mark->open = 0;
+
+  Job j = {copy, k + 1};
+  __atomic_add_fetch(&shr->pending, 1, __ATOMIC_SEQ_CST);
+  pushJob(d, j);
+  // Spinning workers will find the job; only a parked one needs waking.
+  // Paired with the fence after the count goes up in getJob: either it
+  // sees the job or this sees it parked.
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&shr->parked, __ATOMIC_RELAXED) > 0) {
+    pthread_mutex_lock(&shr->parkMtx);
+    pthread_cond_signal(&shr->park);
+    pthread_mutex_unlock(&shr->parkMtx);
   }
+}
 
-  if (isSolved(s)) {
-    solutions++;
-    //printf("Solution:\n");
-    //printSudoku(s);
-    printf("There were %d solutions found.\n", solutions);
-    freeTrail(t);
-    freeMarks(m);
-    return;
+// A lost race for a job is only given up on once the deque is empty
+static int findJob(ThreadInfo* w, Job* j) {
+  SharedInfo* shr = w->SI;
+  if (popJob(&shr->deques[w->id], j))
+    return 1;
+  for (int i = 1; i < shr->numThreads; i++) {
+    Deque* d = &shr->deques[(w->id + i) % shr->numThreads];
+    while (dequeSize(d) > 0) {
+      if (stealJob(d, j))
+	return 1;
+    }
   }
+  return 0;
+}
 
-  // At this point, guessing is required.
-  while (1) {
-    int guessID = findGuessCell(s);
-    int guess = findGuess(s->cs[guessID], s->sz);
-    makeGuess(m, t, s, guessID, guess);
-
-    scanEr = scanSudoku(s, t);
-    if (scanEr == -1) {
-      //printf("Scanning resulted in an error:\n");
-      //printSudoku(s);
-      restEr = chainRestore(m, t, s, 1);
-      if (restEr == -1) {
-	break;
-      }
-    } else if (isSolved(s)) {
-      solutions++;
-      //printf("Solution:\n");
-      //printSudoku(s);
-      restEr = chainRestore(m, t, s, 1);
-      if (restEr == -1) {
+// Blocks until a job turns up, or returns 0 once nothing is left anywhere.
+// Donations usually come soon after a worker goes hungry, so it looks
+// again PARK_SPINS times, yielding in between, before it parks.
+static int getJob(ThreadInfo* w, Job* j) {
+  SharedInfo* shr = w->SI;
+  if (findJob(w, j))
+    return 1;
+  __atomic_add_fetch(&shr->hungry, 1, __ATOMIC_SEQ_CST);
+  int found = 0;
+  for (int i = 0; i < PARK_SPINS && !found; i++) {
+    if (__atomic_load_n(&shr->pending, __ATOMIC_SEQ_CST) == 0)
+      break;
+    sched_yield();
+    found = findJob(w, j);
+  }
+  if (!found) {
+    pthread_mutex_lock(&shr->parkMtx);
+    __atomic_add_fetch(&shr->parked, 1, __ATOMIC_SEQ_CST);
+    // Pairs with the fence in offerWork: findJob's first look at a deque
+    // is a relaxed load, so without it a donation could go unseen here
+    // while the donor saw no one parked
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    // Look again: a donation may have landed before donors saw us parked
+    while (!(found = findJob(w, j))) {
+      if (__atomic_load_n(&shr->pending, __ATOMIC_SEQ_CST) == 0)
 	break;
-      }
+      pthread_cond_wait(&shr->park, &shr->parkMtx);
     }
+    __atomic_sub_fetch(&shr->parked, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&shr->parkMtx);
   }
-  printf("There were %d solutions found.\n", solutions);
+  __atomic_sub_fetch(&shr->hungry, 1, __ATOMIC_SEQ_CST);
+  return found;
 }
 
-// Thread Object Manipulation
+static void finishJob(SharedInfo* shr) {
+  if (__atomic_sub_fetch(&shr->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+    pthread_mutex_lock(&shr->parkMtx);
+    pthread_cond_broadcast(&shr->park);
+    pthread_mutex_unlock(&shr->parkMtx);
+  }
+}
 
-Solutions* makeSStack() {
-  Solutions* s = (Solutions*)malloc(sizeof(Solutions));
-  s->numSols = 0;
-  s->maxSols = 1;
+// Expands the board breadth first until there are at least target live
+// jobs, then deals them out so every worker starts with something to do.
+// Branches that die or finish while scanning never become jobs. Boards
+// come from and go back to pool.
+static void splitFrontier(SharedInfo* shr, BoardPool* pool, Sudoku* root, int target) {
+  const Options* o = shr->opts;
+  Deque frontier;
+  initDeque(&frontier);
+  Job j = {root, 0};
+  if (scanSudoku(root, NULL, o->subsets) != 0) {
+    giveSudoku(pool, root);
+  } else if (isSolved(root)) {
+    addSolution(shr, NULL, root);
+    giveSudoku(pool, root);
+  } else {
+    pushJob(&frontier, j);
+  }
 
-  Sudoku** solutions = (Sudoku**)malloc(sizeof(Sudoku*) * s->maxSols);
-  s->solutions = solutions;
-  return s; 
+  while (dequeSize(&frontier) < target && !pollStop(shr, NULL) && stealJob(&frontier, &j)) {
+    int id = findGuessCell(j.s, o->branch);
+    Word* gs = cellGuesses(j.s, id);
+    for (int d = maskFirst(gs, j.s->nw); d != -1; d = maskNext(gs, j.s->nw, d)) {
+      Sudoku* child = takeCopy(pool, j.s);
+      if (setCellByID(child, d, id, NULL) != 1 || scanSudoku(child, NULL, o->subsets) != 0) {
+	giveSudoku(pool, child);
+      } else if (isSolved(child)) {
+	addSolution(shr, NULL, child);
+	giveSudoku(pool, child);
+      } else {
+	Job c = {child, j.depth + 1};
+	pushJob(&frontier, c);
+      }
+    }
+    giveSudoku(pool, j.s);
+  }
+
+  // The workers have not started, so their deques are still this thread's
+  int n = 0;
+  while (stealJob(&frontier, &j))
+    pushJob(&shr->deques[n++ % shr->numThreads], j);
+  shr->pending = n;
+  freeDeque(&frontier);
+  flushStats(shr);
 }
 
-void reallocSStack(Solutions* s) {
-  s->maxSols *= 2;
-  s->solutions = (Sudoku**)realloc(s->solutions, sizeof(Sudoku*) * s->maxSols);
+// Sudoku Solving
+
+// Tries every guess below a scanned, unsolved board, recording solutions
+// and giving work away as it goes. If it is stopped, the alternatives it
+// never got to are added to the frontier.
+static void search(ThreadInfo* w, Sudoku* s) {
+  SharedInfo* shr = w->SI;
+  const Options* o = shr->opts;
+  Trail* t = w->t;
+  Marks* m = w->m;
+  int scanEr, cut = 1;
+  while (!stopped(shr)) {
+    // Polled before the guess is counted, so a stop charges only the
+    // guesses actually made
+    if (w->nodes + 1 >= w->nextPoll && pollStop(shr, w))
+      break;
+    w->nodes++;
+    offerWork(w, s);
+    int guessID = findGuessCell(s, o->branch);
+    int guess = findGuess(s, guessID);
+    STAT_ADD(nodes, 1);
+    if (w->snap)
+      scanEr = makeGuessSnap(m, w->sn, s, guessID, guess) == 1 ? scanSudoku(s, NULL, o->subsets) : -1;
+    else
+      scanEr = makeGuess(m, t, s, guessID, guess) == 1 ? scanSudoku(s, t, o->subsets) : -1;
+    // Snapshot mode holds one entry per level
+    int held = w->snap ? w->sn->sz : t->sz;
+    STAT_MAX(trailPeak, held);
+    if (o->maxTrail > 0 && held > o->maxTrail)
+      cancelSearch(&shr->stop, STOP_TRAIL);
+    if (scanEr == 0 && !isSolved(s))
+      continue;
+    if (scanEr == 0 && !addSolution(shr, w, s)) {
+      cut = 0;
+      break;
+    }
+    if ((w->snap ? chainRestoreSnap(m, w->sn, s, 1) : chainRestore(m, t, s, 1)) == -1)
+      return;
+  }
+  // Broken off above an unsearched board, plus every branch still open
+  long left = cut;
+  for (int k = 0; k < m->sz; k++)
+    left += m->marks[k].open;
+  __atomic_add_fetch(&shr->frontier, left, __ATOMIC_RELAXED);
 }
 
-void freeSStack(Solutions* s) {
-  for (int i = 0; i < s->numSols; i++) {
-    freeSudoku(s->solutions[i]);
+// Searches one job to the end, then gives its board to w's pool. Every job is a fresh root,
+// so its search starts from empty records.
+void solveJob(ThreadInfo* w, Sudoku* s) {
+  SharedInfo* shr = w->SI;
+  const Options* o = shr->opts;
+  w->snap = o->undo == UNDO_SNAPSHOT || (o->undo == UNDO_AUTO && s->sz <= SNAPSHOT_MAX_SIZE);
+  if (w->snap)
+    resetSnapshots(w->sn, s->bytes);
+  else
+    resetTrail(w->t, s->sz);
+  // Every guess fills a cell, so a search is never deeper than the board
+  resetMarks(w->m, s->tp->ncells);
+  w->nodes = 0;
+  w->found = 0;
+  w->polled = 0;
+  // Jobs still queued when the search is stopped are only freed, and
+  // become part of the frontier
+  if (pollStop(shr, w)) {
+    __atomic_add_fetch(&shr->frontier, 1, __ATOMIC_RELAXED);
+  } else if (scanSudoku(s, NULL, o->subsets) == 0) {
+    if (isSolved(s))
+      addSolution(shr, w, s);
+    else
+      search(w, s);
   }
-  free(s->solutions);
-  free(s);
+  giveSudoku(w->pool, s);
+  if (w->found > 0)
+    __atomic_add_fetch(&shr->found, w->found, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&shr->spent, w->nodes - w->polled, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&shr->jobNodes, w->nodes, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&shr->jobsDone, 1, __ATOMIC_RELAXED);
+  flushStats(shr);
 }
 
-// Threading
+static Report makeReport(SharedInfo* shr, double start) {
+  long count = shr->found;
+  if (shr->opts->limit > 0 && count > shr->opts->limit)
+    count = shr->opts->limit;
+  int reason = shr->stop.reason;
+  Report r = {count, shr->solutions, shr->jobNodes, shr->jobsDone, wallClock() - start,
+	      reason, reason == STOP_NONE, shr->frontier, shr->stats};
+  return r;
+}
 
-void* trailBlaze(void* args) {
-  // Extract relevant information from info
-  TBInfo* info = args;
-  Sudoku* s = info->s;
-  Trail* t = info->t;
-  Marks* m = info->m;
-  SharedInfo* shr = info->SI;
-
-  //printf("Trailblazer has extracted info.\n");
-  
-  // Create necessary vars
-  int guesses = 0;
-  int restEr, scanEr;
-
-  // Create jobs
-  while (1) {
-    // Undo if max guesses reached
-    if (guesses == info->maxDepth) {
-      // Add current state to jobs
-      Sudoku* copy = copySudoku(s);
-      Job j = {copy, guesses};
-      // TODO: Concurrency stuff; add job to joblist
-      // - Obtain lock
-      // - insert job
-      // - increase numJobs
-      // - wake another guy up
-      // - Unlock
-      pthread_mutex_lock(&shr->mtx);
-      shr->jobs[shr->numJobs++] = j;
-      pthread_cond_signal(&shr->done);
-      pthread_mutex_unlock(&shr->mtx);
-
-      restEr = chainRestore(m, t, s, 1);
-      if (restEr == -1) {
-	// No more jobs.
-	break;
-      } else {
-	guesses -= restEr;
-      }
-    }
-    int guessID = findGuessCell(s);
-    int guess = findGuess(s->cs[guessID], s->sz);
-    makeGuess(m, t, s, guessID, guess);
-    guesses++;
-
-    scanEr = scanSudoku(s, t);
-    if (scanEr == -1) {
-      restEr = chainRestore(m, t, s, 1);
-      if (restEr == -1) {
-	break;
-      } else {
-	guesses -= restEr;
-      }
-    } else if (isSolved(s)) {
-      // TODO: Concurrency add solution to shared info
-      // - Obtain lock
-      // - Increase num solutions
-      // - Copy solution to Solution stack
-      // - Unlock
-      //printf("Found a solution!\n");
-      pthread_mutex_lock(&shr->mtx);
-      if (shr->solutions->numSols == shr->solutions->maxSols) {
-	reallocSStack(shr->solutions);
-      }
-      shr->solutions->solutions[shr->solutions->numSols++] = copySudoku(s);
-      pthread_mutex_unlock(&shr->mtx);
-      //printf("Successfully added solution!\n");
-      restEr = chainRestore(m, t, s, 1);
-      if (restEr == -1) {
-	break;
-      } else {
-	guesses -= restEr;
-      }
-    } 
-  }
-  
-  // Done with jobs
-  // TODO: Concurrency end trailblazing phase
-  // - Obtain lock
-  // - Turn off isBranching
-  // - Unlock
-  pthread_mutex_lock(&shr->mtx);
-  shr->stillBranching = 0;
-  pthread_mutex_unlock(&shr->mtx);
-  freeMarks(m);
-  freeTrail(t);
+Report solveSudoku(Sudoku* s, const Options* o) {
+  double start = wallClock();
+  SharedInfo shr;
+  initShared(&shr, 1, o);
+  ThreadInfo w;
+  initWorker(&w, 0, &shr);
+  solveJob(&w, copySudoku(s));
+  Report r = makeReport(&shr, start);
+  freeWorker(&w);
+  freeShared(&shr);
+  return r;
 }
 
+void freeReport(Report* r) {
+  freeSStack(r->solutions);
+  r->solutions = NULL;
+}
+
+// Threading
+
 void* solveThread(void* args) {
-  // Unpack info
   ThreadInfo* info = args;
-  Trail* t = info->t;
-  Marks* m = info->m;
-  SharedInfo* shr = info->SI;
-  Job* job = info->job;
-  Sudoku* s;
-  int sol = 0, jobs = 0;
-  while (1) {
-    // Get Lock
-    // Step 1: Look for job
-    // - Increase waitThreads
-    // - While isBranching && jobs == 0 
-    // - Wait
-    // - If waitThreads == numThreads && jobs == 0
-    // - Unlock
-    // - Break
-    // - Else
-    // - Grab job
-    // - Decrease jobs and waitThreads by 1
-    pthread_mutex_lock(&shr->mtx);
-    shr->waitThreads++;
-    while (shr->stillBranching && shr->numJobs == 0) {
-      //printf("Still Branching: %d\n", shr->stillBranching);
-      pthread_cond_wait(&shr->done, &shr->mtx);
-    }
-    //printf("Testing...\n");
-    if (shr->numJobs == 0) {
-      if (s != NULL)
-	freeSudoku(s);
-      freeTrail(t);
-      freeMarks(m);
-      shr->waitThreads--;
-      pthread_mutex_unlock(&shr->mtx);
-      break;
-    } else {
-      //printf("Grabbed job.\n");
-    }
-    job = &shr->jobs[shr->numJobs-- - 1];
-    shr->waitThreads--;
-    pthread_mutex_unlock(&shr->mtx);
-    // Step 2: Extract from job
-    if (s != NULL)
-      freeSudoku(s);
-    s = job->s;
-    freeTrail(t);
-    freeMarks(m);
-    t = makeTrail();
-    m = createMarks();
-    // Step 3: Solve job
-    while (1) {
-      int scanEr, restEr;
-      int guessID = findGuessCell(s);
-      int guess = findGuess(s->cs[guessID], s->sz);
-      makeGuess(m, t, s, guessID, guess);
-      job->ngs++;
-
-      scanEr = scanSudoku(s, t);
-      if (scanEr == -1) {
-	restEr = chainRestore(m, t, s, 1);
-	if (restEr == -1) {
-	  break;
-	}
-      } else if (isSolved(s)) {
-	// TODO: Concurrency add solution to shared info
-	// - Obtain lock
-	// - Increase num solutions
-	// - Copy solution to Solution stack
-	// - Unlock
-	pthread_mutex_lock(&shr->mtx);
-	if (shr->solutions->numSols == shr->solutions->maxSols) {
-	  reallocSStack(shr->solutions);
-	}
-	shr->solutions->solutions[shr->solutions->numSols] = copySudoku(s);
-	
-	shr->solutions->numSols++;
-	pthread_mutex_unlock(&shr->mtx);
-        
-	//printf("Solutions: %d\n", ++sol);
-	restEr = chainRestore(m, t, s, 1);
-	if (restEr == -1) {
-	  break;
-	}
-      } 
-    }
-    //printf("Completed job %d!\n", ++jobs);
+  Job job;
+  while (getJob(info, &job)) {
+    solveJob(info, job.s);
+    finishJob(info->SI);
   }
+  return NULL;
 }
 
-void* solveSudokuThreads(Sudoku* s, int nt) {
-  Sudoku* copy = copySudoku(s);
+Report solveSudokuThreads(Sudoku* s, int nt, const Options* o) {
+  double start = wallClock();
   SharedInfo shr;
-  shr.stillBranching = 1;
-  shr.numJobs = 0;
-  shr.maxJobs = 100;
-  Job* jobs = (Job*)malloc(sizeof(Job) * shr.maxJobs);
-  shr.jobs = jobs;
-  shr.waitThreads = 0;
-  shr.numThreads = nt;
-  shr.solutions = makeSStack();
-  pthread_mutex_init(&shr.mtx, NULL);
-  pthread_cond_init(&shr.done, NULL);
-
-  TBInfo tb;
-  tb.maxDepth = 1;
-  tb.s = copy;
-  tb.t = makeTrail();
-  tb.m = createMarks();
-  tb.SI = &shr;
-
-  pthread_create(&tb.name, NULL, trailBlaze, &tb);
-
+  initShared(&shr, nt, o);
   ThreadInfo ti[nt];
   for (int i = 0; i < nt; i++) {
-    ti[i].job = NULL;
-    ti[i].t = makeTrail();
-    ti[i].m = createMarks();
-    ti[i].SI = &shr;
+    initWorker(&ti[i], i, &shr);
   }
+  // The first worker's pool is free until its thread starts
+  splitFrontier(&shr, ti[0].pool, copySudoku(s), o->split > 0 ? o->split * nt : 1);
   for (int i = 0; i < nt; i++) {
     pthread_create(&ti[i].name, NULL, solveThread, &ti[i]);
   }
-  pthread_join(tb.name, NULL);
   for (int i = 0; i < nt; i++) {
     pthread_join(ti[i].name, NULL);
+    freeWorker(&ti[i]);
   }
-  pthread_mutex_destroy(&shr.mtx);
-  pthread_cond_destroy(&shr.done);
-  printf("Success! There are %d solutions.\n", shr.solutions->numSols);
-  printf("View solutions? (yes/no)\n");
-  char buffer[128];
-  char ch;
-  int i = 0;
-  while (i < sizeof(buffer) && (ch = getchar()) != '\n' && ch != EOF)
-    buffer[i++] = ch;
-  buffer[i] = 0;
-  if (strcmp("yes", buffer) == 0) {
-    for (int i = 0; i < shr.solutions->numSols; i++) {
-      printSudoku(shr.solutions->solutions[i]);
-    } 
-  }
-  freeSStack(shr.solutions);
-  free(jobs);
-  freeSudoku(copy);
-}
-
-// Main (for testing purposes only)
-
-void printCommands() {
-  printf("help - print a list of commands\n");
-  printf("quit - quit the program\n");
-  printf("import - import a sudoku");
-}
-
-int main(int argc, char* argv[]) {
-  char buffer[128];
-  int running = 1;
-  Sudoku* s = NULL;
-  while (running) {
-    // Receive command
-    printf("> "); fflush(stdout);
-    int i = 0;
-    char ch;
-    while (i < sizeof(buffer) && (ch = getchar()) != '\n' && ch != EOF)
-      buffer[i++] = ch;
-    buffer[i] = 0;
-    if (strcmp("q", buffer) == 0 || strcmp("quit", buffer) == 0) {
-      if (s != NULL)
-	freeSudoku(s);
-      running = 0;
-    } else if (strcmp("h", buffer) == 0 || strcmp("help", buffer) == 0) {
-      printCommands();
-    } else if (strcmp("i", buffer) == 0 || strcmp("import", buffer) == 0) {
-      int sz;
-      printf("What size sudoku are you importing?\n");
-      int er = scanf("%d", &sz);
-      while(ch = getchar() != '\n'){}
-      if (er < 1 || sz < 4 || sz > 81 || sqrt(sz) * sqrt(sz) != sz) {
-	printf("Invalid size. Aborting import.\n");
-	continue;
-      }
-      printf("What file would you like to import?\n");
-      i = 0;
-      while (i < sizeof(buffer) && (ch = getchar()) != '\n' && ch != EOF)
-	buffer[i++] = ch;
-      buffer[i] = 0;
-      s = importSudoku(buffer, sz);
-      if (s == NULL) {
-	printf("File name invalid. Aborting import..\n");
-      }
-    } else if (strcmp("r", buffer) == 0 || strcmp("run", buffer) == 0) {
-      if (s == NULL) {
-	printf("No sudoku available. Please import/make a sudoku first.\n");
-	continue;
-      }
-      printf("Use threads? (yes/no)\n");
-      i = 0;
-      while (i < sizeof(buffer) && (ch = getchar()) != '\n' && ch != EOF)
-	buffer[i++] = ch;
-      buffer[i] = 0;
-      if (strcmp("yes", buffer) == 0) {
-	printf("How many?\n");
-	int nt;
-	int er = scanf("%d", &nt);
-	while(ch = getchar() != '\n'){}
-	if (er < 1 || nt < 1) {
-	  printf("Invalid size. Aborting import.\n");
-	  continue;
-	}
-	solveSudokuThreads(s, 4);
-      } else if (strcmp("no", buffer) == 0) {
-	solveSudoku(s);
-      } else {
-	printf("Not a yes/no. Aborting.\n");
-      }
-    } else {
-      printf("Invalid command. Please try again.\n");
-    }
-  }
+  Report r = makeReport(&shr, start);
+  freeShared(&shr);
+  return r;
 }
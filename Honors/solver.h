@@ -1,65 +1,199 @@
 #ifndef SOLVER_H
 #define SOLVER_H
 
+// Why a search ended early
+#define STOP_NONE 0
+#define STOP_LIMIT 1
+#define STOP_DEADLINE 2
+#define STOP_ABORT 3
+#define STOP_NODES 4
+#define STOP_TRAIL 5
+
+// How a search undoes its guesses. UNDO_AUTO takes snapshots on boards up
+// to SNAPSHOT_MAX_SIZE, where copying the board beats logging its changes.
+#define UNDO_AUTO 0
+#define UNDO_TRAIL 1
+#define UNDO_SNAPSHOT 2
+#define SNAPSHOT_MAX_SIZE 9
+
+// Guesses between looks at a CancelToken
+#define CANCEL_POLL 256
+
+// Looks a worker out of jobs takes at the other deques before it parks
+#define PARK_SPINS 64
+
+// Stops a search from outside: any thread (or signal handler) may cancel
+// it, and it cancels itself once the wall clock passes its deadline. The
+// first reason given sticks.
+typedef struct CancelToken {
+  int reason;
+  double deadline;  // wallClock() time to give up at, 0 for none
+} CancelToken;
+
+// Takes solutions as they are found instead of the Report keeping them.
+// emit may be called from several workers at once, and the board is only
+// good for the length of the call.
+typedef struct SolutionSink {
+  void (*emit)(void* ctx, Sudoku* s);
+  void* ctx;
+} SolutionSink;
+
+// A sink that writes each solution to a file as one line. The first one is
+// flushed straight away and the rest at most every WRITER_FLUSH_SECS.
+#define WRITER_FLUSH_SECS 0.1
+
+typedef struct SolutionWriter {
+  SolutionSink sink;
+  FILE* out;
+  long written;
+  double flushed;  // wallClock() time of the last flush
+  pthread_mutex_t mtx;
+} SolutionWriter;
+
+typedef struct Options {
+  int branch;
+  int subsets;  // largest naked/hidden subset looked for, 0 disables them
+  int split;    // jobs per thread the board is cut into before solving
+  int resplit;  // whether busy workers hand work to idle ones
+  int limit;    // stop after this many solutions, 0 finds them all
+  int countOnly; // count solutions without keeping copies of them
+  int undo;
+  // Budgets, 0 for none: once one runs out the solve returns what it has
+  double maxSecs;  // wall time per solve (per puzzle in a batch)
+  long maxNodes;   // guesses across all workers
+  int maxTrail;    // trail entries any one worker may hold
+  CancelToken* cancel;  // polled while solving, NULL for none
+  SolutionSink* sink;   // NULL keeps solutions in the Report
+} Options;
+
 typedef struct Solutions {
   int numSols;
   int maxSols;
+  int held;       // boards allocated, numSols of them in use
   Sudoku** solutions;
 } Solutions;
 
+// What a solve produced: how many solutions it found (up to the limit) and
+// copies of them unless it only counted, the guesses it made, how many jobs
+// it ran as, and how long it took. A search that ended early says what
+// stopped it and how many unexplored subtrees it left behind.
+typedef struct Report {
+  long count;
+  Solutions* solutions;
+  long nodes;
+  int jobs;
+  double secs;
+  int stopped;
+  int complete;
+  long frontier;
+  Stats stats;     // all zero unless built with SOLVER_STATS
+} Report;
+
 typedef struct Job {
   Sudoku* s;
-  int ngs;
+  int depth;
 } Job;
 
+// A worker's jobs, oldest first, in a Chase-Lev deque. The owner pushes
+// and pops the newest end without locking; thieves take the oldest, which
+// sit closest to the root, by moving top with a compare-and-swap. A full
+// array is replaced by one twice the size, and the old one kept until the
+// deque is freed since a thief may still be reading it.
+#define DEQUE_START 16  // jobs, a power of two
+#define CACHE_LINE 64
+
+typedef struct JobArray {
+  long size;
+  struct JobArray* prev;  // the smaller array this one replaced
+  Job jobs[];
+} JobArray;
+
+// Padded to a cache line so workers' deques don't share one
+typedef struct Deque {
+  long top;        // next job to steal
+  long bottom;     // one past the newest job
+  JobArray* array;
+  char pad[CACHE_LINE - 2 * sizeof(long) - sizeof(JobArray*)];
+} Deque;
+
 typedef struct SharedInfo {
-  int stillBranching;
-  int numJobs;
-  int maxJobs;
-  Job* jobs;
-  int waitThreads;
+  int pending;     // jobs queued or being searched
+  int hungry;      // workers out of work, spinning or parked
+  CancelToken stop; // cancelled once the workers should wind down
+  long found;      // solutions counted so far; see addSolution
+  long spent;      // guesses charged against the node budget
+  long frontier;   // subtrees left unexplored by a stop
+  Stats stats;     // merged from the workers as jobs finish
+  int jobsDone;
+  long jobNodes;   // guesses made across all finished jobs
   int numThreads;
+  Deque* deques;
   Solutions* solutions;
-  pthread_mutex_t mtx;
-  pthread_cond_t done;
+  const Options* opts;
+  pthread_mutex_t mtx;  // guards solutions and stats
+  // Idle workers park here once spinning has found nothing
+  int parked;
+  pthread_mutex_t parkMtx;
+  pthread_cond_t park;
 } SharedInfo;
 
+// Aligned to a cache line, so the counts a worker bumps on every guess
+// don't share one with a neighbour's record
 typedef struct ThreadInfo {
-  Job* job;
+  int id;
+  long nodes;      // guesses made in the current job
+  long found;      // solutions found in the current job
+  long polled;     // nodes when the budget was last charged
+  long nextPoll;   // nodes at which to poll again
+  int snap;        // whether the current job undoes with snapshots
   Trail* t;
+  Snapshots* sn;
   Marks* m;
+  BoardPool* pool;  // boards for jobs this worker gives away or finishes
   SharedInfo* SI;
   pthread_t name;
-} ThreadInfo;
-
-typedef struct TBInfo {
-  int maxDepth;
-  Sudoku* s;
-  Trail* t;
-  Marks* m;
-  SharedInfo* SI;
-  pthread_t name;
-} TBInfo;
+} __attribute__((aligned(CACHE_LINE))) ThreadInfo;
 
 // Sudoku Scanning
-int findSingleton(Cell* c, int sz);
-int findSingletons(Sudoku* s, Trail* t);
-int findHiddenSinglesGroup(Sudoku* s, Group* g, Trail* t);
-int findHiddenSingles(Sudoku* s, Trail* t);
-int findPreemptiveSetAux(Sudoku* s, Group* g, int curr, int noin, int inIDs[], int nogs, int gs[], Trail* t);
-int findPreemptiveSet(Sudoku* s, Group* g, Trail* t);
-int findPreemptiveSets(Sudoku* s, Trail* t);
-int scanSudoku(Sudoku* s, Trail* t);
+int scanSudoku(Sudoku* s, Trail* t, int maxSubset);
 
 // Sudoku Guessing
-void makeGuess(Marks* m, Trail* t, Sudoku* s, int ID, int guess);
-int findGuessCell(Sudoku* s);
-int findGuess(Cell* c, int sz);
-void restore(Marks* m, Trail* t, Sudoku* s);
+int makeGuess(Marks* m, Trail* t, Sudoku* s, int ID, int guess);
+int removeGuessT(Sudoku* s, int id, int n, Trail* t);
+int makeGuessSnap(Marks* m, Snapshots* sn, Sudoku* s, int ID, int guess);
+int chainRestoreSnap(Marks* m, Snapshots* sn, Sudoku* s, int undos);
+int findGuessCell(Sudoku* s, int branch);
+int findGuess(Sudoku* s, int id);
+void rewindSudoku(Sudoku* s, Trail* t, int to);
 int chainRestore(Marks* m, Trail* t, Sudoku* s, int undos);
 
+// Thread Object Manipulation
+Solutions* makeSStack();
+void clearSStack(Solutions* s);
+void freeSStack(Solutions* s);
+
+// Search State
+void initShared(SharedInfo* shr, int nt, const Options* o);
+void resetShared(SharedInfo* shr);
+void freeShared(SharedInfo* shr);
+void initWorker(ThreadInfo* w, int id, SharedInfo* shr);
+void freeWorker(ThreadInfo* w);
+double wallClock();
+
+// Solution Sinks
+void initWriter(SolutionWriter* wr, FILE* out);
+void freeWriter(SolutionWriter* wr);
+
+// Cancellation
+void initCancel(CancelToken* c, double timeout);
+void cancelSearch(CancelToken* c, int reason);
+int checkCancel(CancelToken* c);
+
 //Sudoku Solving
-void solveSudoku(Sudoku* s);
+void solveJob(ThreadInfo* w, Sudoku* s);
+Report solveSudoku(Sudoku* s, const Options* o);
+Report solveSudokuThreads(Sudoku* s, int nt, const Options* o);
+void freeReport(Report* r);
 
 #endif
 
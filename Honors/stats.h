@@ -0,0 +1,41 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Rules timed separately by scanSudoku
+#define RULE_SINGLES 0
+#define RULE_HIDDEN 1
+#define RULE_SUBSETS 2
+#define NUM_RULES 3
+
+// Search counters. Each thread counts into its own copy, which is merged
+// into the solve's totals as jobs finish.
+typedef struct Stats {
+  long nodes;          // guesses made
+  long backtracks;     // decision levels undone
+  long singles;        // cells set because one candidate was left
+  long hiddenSingles;  // digits placed in the one cell of a unit that takes them
+  long subsetElims;    // candidates removed by naked and hidden subsets
+  long passes;         // rounds of the scan's rule loop
+  long trailPeak;      // most trail entries held at once
+  double ruleSecs[NUM_RULES];
+} Stats;
+
+void mergeStats(Stats* into, const Stats* from);
+
+// Counting is only built in with -DSOLVER_STATS (make STATS=1); otherwise
+// these expand to nothing and the hot paths are left untouched
+#ifdef SOLVER_STATS
+extern __thread Stats threadStats;
+double wallClock();
+#define STAT_ADD(field, n) (threadStats.field += (n))
+#define STAT_MAX(field, v) (threadStats.field = (v) > threadStats.field ? (v) : threadStats.field)
+#define STAT_TIME_START(var) double var = wallClock()
+#define STAT_TIME_END(rule, var) (threadStats.ruleSecs[rule] += wallClock() - (var))
+#else
+#define STAT_ADD(field, n) ((void)0)
+#define STAT_MAX(field, v) ((void)0)
+#define STAT_TIME_START(var) ((void)0)
+#define STAT_TIME_END(rule, var) ((void)0)
+#endif
+
+#endif
@@ -1,65 +1,155 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
+#include <string.h>
+#include <pthread.h>
 #include "cells.h"
 #include "trail.h"
 #include "sudoku.h"
+#include "kernels.h"
 
 // Basic Sudoku Functions
+
+static void bindSudoku(Sudoku* s) {
+  int ncells = s->tp->ncells;
+  int nunits = s->tp->nunits;
+  s->gs = (Word*)(s + 1);
+  s->vals = (int*)(s->gs + ncells * s->nw);
+  s->ngs = s->vals + ncells;
+  s->pend = s->ngs + ncells;
+  s->hsUnits = s->pend + ncells;
+  s->subUnits = s->hsUnits + nunits;
+  s->dirty = (unsigned char*)(s->subUnits + nunits);
+}
+
+// Empties a board back to how makeSudoku leaves it
+static void clearSudoku(Sudoku* s) {
+  int ncells = s->tp->ncells;
+  int nunits = s->tp->nunits;
+  s->rem = ncells;
+  s->kn = getKernel(s->sz);
+  for (int i = 0; i < ncells; i++) {
+    maskFill(cellGuesses(s, i), s->sz);
+    s->vals[i] = 0;
+    s->ngs[i] = s->sz;
+  }
+  // Nothing has been looked at yet, so every unit starts out pending
+  s->npend = 0;
+  s->nhs = nunits;
+  s->nsub = nunits;
+  for (int u = 0; u < nunits; u++) {
+    s->hsUnits[u] = u;
+    s->subUnits[u] = u;
+    s->dirty[u] = DIRTY_HS | DIRTY_SUB;
+  }
+}
+
 Sudoku* makeSudoku(int size) {
-  Sudoku* s = (Sudoku*)malloc(sizeof(Sudoku));
-  Cell** cells = (Cell**)malloc(sizeof(Cell*) * size * size);
+  const Topology* tp = getTopology(size);
+  int ncells = tp->ncells;
+  int nunits = tp->nunits;
+  int nw = maskWords(size);
+  int bytes = sizeof(Sudoku) + sizeof(Word) * ncells * nw + sizeof(int) * (ncells * 3 + nunits * 2) + nunits;
+  Sudoku* s = (Sudoku*)malloc(bytes);
   s->sz = size;
-  s->rem = size * size;
-  s->cs = cells;
-
-  for (int i = 0; i < size * size; i++)
-    s->cs[i] = makeCell(size, i);
+  s->nw = nw;
+  s->bytes = bytes;
+  s->tp = tp;
+  bindSudoku(s);
+  clearSudoku(s);
   return s;
 }
 
 void freeSudoku(Sudoku* s) {
-  for (int i = 0; i < s->sz * s->sz; i++)
-    freeCell(s->cs[i]);
-  free(s->cs);
   free(s);
 }
 
-int removeGuesses(int guess, Group* g, int ignore, Trail* t) {
-  int violations = 0;
-  for (int i = 0; i < g->ncs; i++) {
-    if (g->cs[i]->id != ignore && removeGuessT(g->cs[i], guess, t) == 0) {
-      violations++;
+int setCell(Sudoku* s, int v, int r, int c, Trail* t) {
+  return setCellByID(s, v, getID(r, c, s->sz), t);
+}
+
+int setCellByID(Sudoku* s, int v, int id, Trail* t) {
+  return s->kn->setCell(s, v, id, t);
+}
+
+// Gathers the givens of every unit into used, nw words per unit. Returns
+// 0 if a value is too big for the board or two givens in a unit clash.
+static int gatherUnits(const Topology* tp, int nw, const unsigned char* givens, Word* used) {
+  memset(used, 0, sizeof(Word) * tp->nunits * nw);
+  if (nw == 1) {
+    // A blank shifts in no bit, so blanks and givens take the same path
+    // and no branch hangs on what a cell holds
+    Word clash = 0;
+    int bad = 0;
+    for (int id = 0; id < tp->ncells; id++) {
+      int v = givens[id];
+      bad |= v > tp->sz;
+      Word bit = (Word)(v != 0) << ((v - 1) & (WORD_BITS - 1));
+      const int* us = tp->unitsOf + id * 3;
+      clash |= (used[us[0]] | used[us[1]] | used[us[2]]) & bit;
+      used[us[0]] |= bit;
+      used[us[1]] |= bit;
+      used[us[2]] |= bit;
+    }
+    return !bad && clash == 0;
+  }
+  for (int id = 0; id < tp->ncells; id++) {
+    int v = givens[id];
+    if (v == 0)
+      continue;
+    if (v > tp->sz)
+      return 0;
+    const int* us = tp->unitsOf + id * 3;
+    for (int k = 0; k < 3; k++) {
+      Word* u = used + us[k] * nw;
+      if (maskHas(u, v))
+	return 0;
+      maskAdd(u, v);
     }
   }
-  return violations;
+  return 1;
 }
 
-int setCell(Sudoku* s, int v, int r, int c, Trail* t) {
-  Cell* cell = s->cs[getID(r, c, s->sz)];
-  if (cell->val > 0)
-    return 0;
-  if (cell->gs[v] == 0)
-    return -1;
-  Group* row = getFilteredRow(s, r);
-  Group* col = getFilteredCol(s, c);
-  Group* box = getFilteredBox(s, getBoxByID(cell->id, s->sz));
-  int rowV = removeGuesses(v, row, cell->id, t);
-  freeGroup(row);
-  int colV = removeGuesses(v, col, cell->id, t);
-  freeGroup(col);
-  int boxV = removeGuesses(v, box, cell->id, t);
-  freeGroup(box);
-  setValueT(cell, v, s->sz, t);
-  s->rem--;
-  if (rowV == 0 && colV == 0 && boxV == 0)
-    return 1;
-  else
-    return -2;
+// Whether givens (one value per cell, 0 for a blank) fit on a board of
+// tp's size without two of them clashing. Unlike loadSudoku this builds no
+// board, so it cannot tell that a blank has been left with no candidate.
+int checkGivens(const Topology* tp, const unsigned char* givens) {
+  int nw = maskWords(tp->sz);
+  Word used[tp->nunits * nw];
+  return gatherUnits(tp, nw, givens, used);
 }
 
-int setCellByID(Sudoku* s, int v, int id, Trail* t) {
-  return setCell(s, v, getRowByID(id, s->sz), getColByID(id, s->sz), t);
+// Places every given on a fresh board in one go. givens holds one value
+// per cell, 0 for a blank. Rather than each given clearing its own peers,
+// the digits of every unit are gathered first and each blank is left with
+// whatever its three units have not used. Returns 1, or 0 if the givens
+// clash or leave some cell without a candidate.
+int loadSudoku(Sudoku* s, const unsigned char* givens) {
+  const Topology* tp = s->tp;
+  int nw = s->nw;
+  Word used[tp->nunits * nw];
+  if (!gatherUnits(tp, nw, givens, used))
+    return 0;
+
+  for (int id = 0; id < tp->ncells; id++) {
+    Word* gs = cellGuesses(s, id);
+    if (givens[id] != 0) {
+      s->vals[id] = givens[id];
+      s->ngs[id] = 0;
+      maskClear(gs, nw);
+      s->rem--;
+      continue;
+    }
+    const int* us = tp->unitsOf + id * 3;
+    for (int i = 0; i < nw; i++)
+      gs[i] &= ~(used[us[0] * nw + i] | used[us[1] * nw + i] | used[us[2] * nw + i]);
+    int n = maskCount(gs, nw);
+    if (n == 0)
+      return 0;
+    s->ngs[id] = n;
+    if (n == 1)
+      s->pend[s->npend++] = id;
+  }
+  return 1;
 }
 
 int isSolved(Sudoku* s) {
@@ -67,87 +157,125 @@ int isSolved(Sudoku* s) {
 }
 
 Sudoku* copySudoku(Sudoku* orig) {
-  Sudoku* new = (Sudoku*)malloc(sizeof(Sudoku));
-  Cell** cells = (Cell**)malloc(sizeof(Cell*) * orig->sz * orig->sz);
-  new->sz = orig->sz;
-  new->rem = orig->rem;
-  new->cs = cells;
-
-  for (int i = 0; i < new->sz * new->sz; i++)
-    new->cs[i] = copyCell(orig->cs[i], new->sz);
+  Sudoku* new = (Sudoku*)malloc(orig->bytes);
+  copySudokuInto(new, orig);
   return new;
 }
 
-// Sudoku sectioning
-
-Group* getRow(Sudoku* s, int r) {
-  Group* row = makeGroup(s->sz);
-  for (int i = 0; i < s->sz; i++)
-    addCell(row, s->cs[getID(r, i, s->sz)]);
-  return row; 
+void copySudokuInto(Sudoku* dst, Sudoku* orig) {
+  memcpy(dst, orig, orig->bytes);
+  bindSudoku(dst);
 }
 
-Group* getFilteredRow(Sudoku* s, int r) {
-  Group* row = makeGroup(s->sz);
-  for (int i = 0; i < s->sz; i++) {
-    Cell* cell = s->cs[getID(r, i, s->sz)];
-    if (cell->val == 0) {
-      addCell(row, cell);
-    }  
-  }
-  return row; 
+// Board Pools
+
+BoardPool* makePool() {
+  BoardPool* p = (BoardPool*)malloc(sizeof(BoardPool));
+  p->sz = 0;
+  p->n = 0;
+  return p;
 }
 
-Group* getCol(Sudoku* s, int c) {
-  Group* col = makeGroup(s->sz);
-  for (int i = 0; i < s->sz; i++)
-    addCell(col, s->cs[getID(i, c, s->sz)]);
-  return col;
+void freePool(BoardPool* p) {
+  for (int i = 0; i < p->n; i++)
+    free(p->boards[i]);
+  free(p);
 }
 
-Group* getFilteredCol(Sudoku* s, int c) {
-  Group* col = makeGroup(s->sz);
-  for (int i = 0; i < s->sz; i++) {
-    Cell* cell = s->cs[getID(i, c, s->sz)];
-    if (cell->val == 0) {
-      addCell(col, cell);
-    }  
-  }
-  return col;
+// A blank board, as makeSudoku would give
+Sudoku* takeSudoku(BoardPool* p, int size) {
+  if (p->n == 0 || p->sz != size)
+    return makeSudoku(size);
+  Sudoku* s = p->boards[--p->n];
+  clearSudoku(s);
+  return s;
+}
 
+Sudoku* takeCopy(BoardPool* p, Sudoku* orig) {
+  Sudoku* s;
+  if (p->n > 0 && p->sz == orig->sz)
+    s = p->boards[--p->n];
+  else
+    s = (Sudoku*)malloc(orig->bytes);
+  copySudokuInto(s, orig);
+  return s;
 }
 
-Group* getBox(Sudoku* s, int bxID) {
-  int root = (int)sqrt(s->sz);
-  Group* box = makeGroup(s->sz);
-  int bxRow = (bxID - (bxID % root))/root;
-  int rowSt = bxRow * root;
-  int bxCol = bxID % root;
-  int colSt = bxCol * root;
-  for (int r = rowSt; r < rowSt + root; r++) {
-    for (int c = colSt; c < colSt + root; c++) {
-      addCell(box, s->cs[getID(r, c, s->sz)]);
-    }
-  } 
-  return box;
+// Takes s back in place of freeSudoku. A board of another size empties the
+// pool, which only ever holds one size.
+void giveSudoku(BoardPool* p, Sudoku* s) {
+  if (s->sz != p->sz) {
+    for (int i = 0; i < p->n; i++)
+      free(p->boards[i]);
+    p->n = 0;
+    p->sz = s->sz;
+  }
+  if (p->n == POOL_MAX)
+    free(s);
+  else
+    p->boards[p->n++] = s;
 }
 
-Group* getFilteredBox(Sudoku* s, int bxID) {
-  int root = (int)sqrt(s->sz);
-  Group* box = makeGroup(s->sz);
-  int bxRow = (bxID - (bxID % root))/root;
-  int rowSt = bxRow * root;
-  int bxCol = bxID % root;
-  int colSt = bxCol * root;
-  for (int r = rowSt; r < rowSt + root; r++) {
-    for (int c = colSt; c < colSt + root; c++) {
-      Cell* cell = s->cs[getID(r, c, s->sz)];
-      if (cell->val == 0) {
-	addCell(box, cell);
+// Sudoku topology
+
+static Topology* topologies[MAX_SIZE + 1];
+static pthread_mutex_t topologyMtx = PTHREAD_MUTEX_INITIALIZER;
+
+static Topology* makeTopology(int sz) {
+  int root = 1;
+  while (root * root < sz)
+    root++;
+  int ncells = sz * sz;
+  Topology* tp = (Topology*)malloc(sizeof(Topology));
+  tp->sz = sz;
+  tp->root = root;
+  tp->ncells = ncells;
+  tp->nunits = 3 * sz;
+  tp->npeers = 2 * (sz - 1) + (root - 1) * (root - 1);
+  tp->units = (int*)malloc(sizeof(int) * tp->nunits * sz);
+  tp->peers = (int*)malloc(sizeof(int) * ncells * tp->npeers);
+  tp->unitsOf = (int*)malloc(sizeof(int) * ncells * 3);
+  tp->boxOf = (int*)malloc(sizeof(int) * ncells);
+
+  for (int id = 0; id < ncells; id++) {
+    int r = getRowByID(id, sz), c = getColByID(id, sz);
+    int bx = (r / root) * root + c / root;
+    int pos = (r % root) * root + c % root;
+    tp->boxOf[id] = bx;
+    tp->units[r * sz + c] = id;
+    tp->units[(sz + c) * sz + r] = id;
+    tp->units[(2 * sz + bx) * sz + pos] = id;
+    tp->unitsOf[id * 3] = r;
+    tp->unitsOf[id * 3 + 1] = sz + c;
+    tp->unitsOf[id * 3 + 2] = 2 * sz + bx;
+  }
+
+  // Peers are the union of a cell's three units, excluding the cell
+  char seen[ncells];
+  for (int id = 0; id < ncells; id++) {
+    int* peers = tp->peers + id * tp->npeers;
+    int np = 0;
+    memset(seen, 0, ncells);
+    seen[id] = 1;
+    for (int k = 0; k < 3; k++) {
+      const int* unit = getUnit(tp, tp->unitsOf[id * 3 + k]);
+      for (int i = 0; i < sz; i++) {
+	if (!seen[unit[i]]) {
+	  seen[unit[i]] = 1;
+	  peers[np++] = unit[i];
+	}
       }
     }
-  } 
-  return box;
+  }
+  return tp;
+}
+
+const Topology* getTopology(int sz) {
+  pthread_mutex_lock(&topologyMtx);
+  if (topologies[sz] == NULL)
+    topologies[sz] = makeTopology(sz);
+  pthread_mutex_unlock(&topologyMtx);
+  return topologies[sz];
 }
 
 // Sudoku helper functions
@@ -161,17 +289,20 @@ int getRowByID(int id, int sz) {
 int getColByID(int id, int sz) {
   return id % sz;
 }
-int getBoxByID(int id, int sz) {
-  int root = (int)sqrt(sz);
-  int bxRow = id / sz / root;
-  int bxCol = id % sz / root;
-  return bxRow * root + bxCol;
-}
 
 // Sudoku printing
 
+void printCell(Sudoku* s, int id) {
+  Word* gs = cellGuesses(s, id);
+  printf("Cell ID: %d with %d Guesses: { \n", id, s->ngs[id]);
+  for (int i = 1; i <= s->sz; i++) {
+    printf("%d ", maskHas(gs, i));
+  }
+  printf("}\n");
+}
+
 void printSudoku(Sudoku* s) {
-  int root = (int)sqrt(s->sz);
+  int root = s->tp->root;
 
   int row = 0;
   for (int i = 0; i < root; i++) {
@@ -186,31 +317,31 @@ void printSudoku(Sudoku* s) {
 
 
 void printRow(Sudoku* s, int r) {
-  Group* row = getRow(s, r);
-  int root = (int)sqrt(s->sz);
+  const int* row = getUnit(s->tp, r);
+  int root = s->tp->root;
 
   printf("|");
   int col = 0;
   for (int i = 0; i < root; i++) {
     for (int j = 0; j < root; j++) {
       printf("|");
-      if (row->cs[col]->ngs != 0) 
+      int id = row[col];
+      if (s->ngs[id] != 0) 
 	printf("  ");
-      else if (row->cs[col]->val == 0)
+      else if (s->vals[id] == 0)
 	printf(" ?");
       else
-	printf("%2d", row->cs[col]->val); 
+	printf("%2d", s->vals[id]); 
       col++;     
     }
     printf("|");
   }
   printf("|\n");
-  freeGroup(row);
 }
 
 
 void printDivider(int size) {
-  int root = (int)sqrt(size);
+  int root = getTopology(size)->root;
   for (int i = 0; i < root; i++) {
     printf("[]");
     for (int j = 0; j < 3 * root - 1; j++)
@@ -219,6 +350,23 @@ void printDivider(int size) {
   printf("[]\n");
 }
 
+// One line of the board's values in row order, a symbol per cell. Boards
+// whose values run past SYMBOL_MAX get space-separated numbers instead.
+char* formatSudoku(Sudoku* s) {
+  int ncells = s->tp->ncells;
+  int wide = s->sz > SYMBOL_MAX;
+  char* text = (char*)malloc(ncells * (wide ? 3 : 1) + 1);
+  char* p = text;
+  for (int id = 0; id < ncells; id++) {
+    if (wide)
+      p += sprintf(p, id == 0 ? "%d" : " %d", s->vals[id]);
+    else
+      *p++ = s->vals[id] < 10 ? '0' + s->vals[id] : 'A' + s->vals[id] - 10;
+  }
+  *p = 0;
+  return text;
+}
+
 // Sudoku importing
 Sudoku* importSudoku(char* path, int sz) {
   // Setup Path
@@ -227,12 +375,12 @@ Sudoku* importSudoku(char* path, int sz) {
     return NULL;
   }
   Sudoku* s = makeSudoku(sz);
-  char* line = (char*)malloc(sizeof(char) * 10);
-  int max = 10;
-  while ((line = fgets(line, max, file)) != NULL) {
+  char* line = (char*)malloc(sizeof(char) * 64);
+  int max = 64;
+  while (fgets(line, max, file) != NULL) {
     int row, col, val;
     if (sscanf(line, "%d %d %d\n", &row, &col, &val) == 3) {
-      if (row < 1 || row > 9 || col < 1 || col > 9 || val < 1 || val > 9) {
+      if (row < 1 || row > sz || col < 1 || col > sz || val < 1 || val > sz) {
 	printf("INVALID: Unacceptable values for <row> <col> <val> -> %s", line);
       } else {
 	int error;
@@ -254,6 +402,7 @@ Sudoku* importSudoku(char* path, int sz) {
       printf("INVALID: Unacceptable line -> %s", line);
   }
   free(line);
+  fclose(file);
   return s;
 }
 Sudoku* createSudoku(int sz);
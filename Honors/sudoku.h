@@ -4,40 +4,103 @@
 #define IMPORT 0
 #define CREATE 1
 
+#define MAX_SIZE 81
+
+// Static layout of every board of one size, built once and shared
+// read-only by all boards and threads. Units are numbered rows first,
+// then columns, then boxes.
+typedef struct Topology {
+  int sz;
+  int root;
+  int ncells;
+  int nunits;
+  int npeers;
+  int* units;    // nunits * sz cell ids
+  int* peers;    // ncells * npeers cell ids
+  int* unitsOf;  // ncells * 3 unit ids (row, col, box)
+  int* boxOf;
+} Topology;
+
+// Unit flags for pending propagation work
+#define DIRTY_HS 1
+#define DIRTY_SUB 2
+
+// A board is one contiguous block: this header followed by the candidate
+// masks (nw words per cell), the cell values and the candidate counts,
+// then the propagation work lists. Cells whose candidates drop to one
+// wait in pend; units that lost a candidate wait in hsUnits for hidden
+// singles and in subUnits for the subset rules.
 typedef struct Sudoku {
   int sz;
   int rem;
-  Cell** cs;
+  int nw;
+  int bytes;
+  int npend;
+  int nhs;
+  int nsub;
+  const Topology* tp;
+  const struct Kernel* kn;
+  Word* gs;
+  int* vals;
+  int* ngs;
+  int* pend;
+  int* hsUnits;
+  int* subUnits;
+  unsigned char* dirty;
 } Sudoku;
 
+// Spare boards of one size, kept to be handed out again rather than freed.
+// A pool belongs to one thread; boards may move between pools, so a board
+// taken from one pool can be given back to another.
+#define POOL_MAX 64
+
+typedef struct BoardPool {
+  int sz;
+  int n;
+  Sudoku* boards[POOL_MAX];
+} BoardPool;
+
 // Basic Sudoku Functions
 Sudoku* makeSudoku(int size);
 void freeSudoku(Sudoku* s);
-int removeGuesses(int guess, Group* g, int ignore, Trail* t);
 int setCell(Sudoku* s, int v, int r, int c, Trail* t);
 int setCellByID(Sudoku* s, int v, int id, Trail* t);
+int loadSudoku(Sudoku* s, const unsigned char* givens);
+int checkGivens(const Topology* tp, const unsigned char* givens);
 int isSolved(Sudoku* s);
 Sudoku* copySudoku(Sudoku* orig);
+void copySudokuInto(Sudoku* dst, Sudoku* orig);
+BoardPool* makePool();
+void freePool(BoardPool* p);
+Sudoku* takeSudoku(BoardPool* p, int size);
+Sudoku* takeCopy(BoardPool* p, Sudoku* orig);
+void giveSudoku(BoardPool* p, Sudoku* s);
+static inline Word* cellGuesses(Sudoku* s, int id) {
+  return s->gs + id * s->nw;
+}
 
-// Sudoku Sectioning
-
-Group* getRow(Sudoku* s, int r);
-Group* getFilteredRow(Sudoku* s, int r);
-Group* getCol(Sudoku* s, int c);
-Group* getFilteredCol(Sudoku* s, int c);
-Group* getBox(Sudoku* s, int bxID);
-Group* getFilteredBox(Sudoku* s, int bxID);
+// Sudoku Topology
+const Topology* getTopology(int sz);
+static inline const int* getUnit(const Topology* tp, int u) {
+  return tp->units + u * tp->sz;
+}
+static inline const int* getPeers(const Topology* tp, int id) {
+  return tp->peers + id * tp->npeers;
+}
 
 // Sudoku Helper Functions
 int getID(int r, int c, int sz);
 int getRowByID(int id, int sz);
 int getColByID(int id, int sz);
-int getBoxByID(int id, int sz);
 
 // Sudoku Printing
+// Values up to 35 print as one symbol each: 1-9, then A-Z
+#define SYMBOL_MAX 35
+void printCell(Sudoku* s, int id);
 void printSudoku(Sudoku* s);
 void printRow(Sudoku* s, int r);
 void printDivider(int size);
+char* formatSudoku(Sudoku* s);
 
 // Sudoku Importing
 Sudoku* importSudoku(char* path, int sz);
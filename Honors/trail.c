@@ -1,76 +1,73 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "cells.h"
 #include "trail.h"
 
-// Data creation
-Data makeData(int type, int ID, int v) {
-  Data d = {type, ID, v};
-  return d;
-}
-
-void printData(Data d) {
-  printf("{%d %d %d}\n", d.type, d.cellID, d.value);
-}
-
 // Trail functions
 
+// Empty until resetTrail sizes it for a board
 Trail* makeTrail() {
   Trail* t = (Trail*)malloc(sizeof(Trail));
   t->sz = 0;
-  t->max = MAX_CHANGES;
-  t->changes = (Data*)malloc(sizeof(Data) * t->max);
+  t->max = 0;
+  t->changes = NULL;
+  t->ncells = 0;
+  t->level = 0;
+  t->next = 1;
+  t->stamps = NULL;
+  t->depth = 0;
+  t->levels = NULL;
   return t;
 }
 
+// Only reached if the size bound is wrong; kept as a safety net
 Trail* reallocTrail(Trail* t) {
-  t->max *= 2;
-  t->changes = (Data*)realloc(t->changes, t->max);
+  t->max = t->max > 0 ? t->max * 2 : 64;
+  t->changes = (Data*)realloc(t->changes, sizeof(Data) * t->max);
   return t;
 }
 
 void freeTrail(Trail* t) {
   free(t->changes);
+  free(t->stamps);
+  free(t->levels);
   free(t);
 }
 
-void makeChange(Trail* t, int type, int ID, int v) {
-  if (t->sz == t->max) {
-    reallocTrail(t);
+// Empties the trail for a search of an sz x sz board, growing it first if
+// the board is bigger than any it has held
+void resetTrail(Trail* t, int sz) {
+  int ncells = sz * sz;
+  if (ncells > t->ncells) {
+    free(t->changes);
+    free(t->stamps);
+    free(t->levels);
+    t->ncells = ncells;
+    t->max = ncells * sz;
+    t->changes = (Data*)malloc(sizeof(Data) * t->max);
+    // Every guess fills a cell, so no search goes deeper than ncells
+    t->levels = (long*)malloc(sizeof(long) * (ncells + 1));
+    t->stamps = (long*)calloc(ncells, sizeof(long));
   }
-  Data data = makeData(type, ID, v);
-  //printf("Saving data: ");
-  //printData(data);
-  t->changes[t->sz++] = data;
-}
-
-Data extractChange(Trail* t) {
-  Data data = t->changes[t->sz - 1];
-  //printf("Restoring data: ");
-  //printData(data);
-  t->sz--;
-  return data;
-}
-
-// Cell functions with Trail
-void setValueT(Cell* c, int v, int sz, Trail* t) {
-  if (t != NULL) {
-    for (int i = 1; i <= sz; i++) {
-      if (c->gs[i] == 1) {
-	makeChange(t, 0, c->id, i);
-      }
-    }
-    makeChange(t, 1, c->id, v);
-  }
-  setValue(c, v, sz);
-} 
+  t->sz = 0;
+  t->depth = 0;
+  t->level = t->next++;
+}
 
-int removeGuessT(Cell* c, int n, Trail* t) {
-  if (t != NULL && c->gs[n] == 1) {
-    makeChange(t, 0, c->id, n);
-  }
+// Starts a new decision level on top of the current one
+void enterLevel(Trail* t) {
+  t->levels[t->depth++] = t->level;
+  t->level = t->next++;
+}
 
-  return removeGuess(c, n);
+// Drops the current level, whose entries begin at index, once the board
+// has been rewound past it
+void leaveLevel(Trail* t, int index) {
+  for (int i = index; i < t->sz; i++)
+    t->stamps[t->changes[i].cellID] = t->changes[i].stamp;
+  t->sz = index;
+  t->level = t->levels[--t->depth];
 }
 
 // Mark Functions
@@ -79,30 +76,86 @@ Marks* createMarks() {
   Marks* m = (Marks*)malloc(sizeof(Marks));
   m->sz = 0;
   m->max = 1;
-  m->marks = (int*)malloc(sizeof(int) * m->max);
+  m->marks = (Mark*)malloc(sizeof(Mark) * m->max);
   return m;
 }
 
 Marks* reallocMarks(Marks* m) {
   m->max *= 2;
-  m->marks = (int*)realloc(m->marks, sizeof(int) * m->max);
+  m->marks = (Mark*)realloc(m->marks, sizeof(Mark) * m->max);
   return m;
 }
 
+// Empties the stack, making room for depth levels up front
+void resetMarks(Marks* m, int depth) {
+  if (m->max < depth) {
+    m->max = depth;
+    m->marks = (Mark*)realloc(m->marks, sizeof(Mark) * m->max);
+  }
+  m->sz = 0;
+}
+
 void freeMarks(Marks* m) {
   free(m->marks);
   free(m);
 }
 
-void addMark(Marks* m, int index) {
+void addMark(Marks* m, int index, int cell, int guess, int open) {
   if (m->sz == m->max) {
     reallocMarks(m);
   }
-  m->marks[m->sz++] = index;
+  Mark mark = {index, cell, guess, open};
+  m->marks[m->sz++] = mark;
 }
 
-int extractMark(Marks* m) {
-  int mark = m->marks[m->sz - 1];
+Mark extractMark(Marks* m) {
+  Mark mark = m->marks[m->sz - 1];
   m->sz--;
   return mark;
 }
+
+// Snapshot Functions
+
+Snapshots* makeSnapshots() {
+  Snapshots* sn = (Snapshots*)malloc(sizeof(Snapshots));
+  sn->sz = 0;
+  sn->max = 0;
+  sn->bytes = 0;
+  sn->stride = 0;
+  sn->boards = NULL;
+  return sn;
+}
+
+void freeSnapshots(Snapshots* sn) {
+  free(sn->boards);
+  free(sn);
+}
+
+void reallocSnapshots(Snapshots* sn) {
+  sn->max *= 2;
+  sn->boards = (char*)realloc(sn->boards, (long)sn->stride * sn->max);
+}
+
+// Empties the stack for boards of the given size
+void resetSnapshots(Snapshots* sn, int bytes) {
+  int stride = (bytes + 15) & ~15;
+  if (stride > sn->stride) {
+    free(sn->boards);
+    if (sn->max == 0)
+      sn->max = SNAPSHOT_LEVELS;
+    sn->boards = (char*)malloc((long)stride * sn->max);
+    sn->stride = stride;
+  }
+  sn->sz = 0;
+  sn->bytes = bytes;
+}
+
+void pushSnapshot(Snapshots* sn, const void* board) {
+  if (sn->sz == sn->max)
+    reallocSnapshots(sn);
+  memcpy(sn->boards + (long)sn->sz++ * sn->stride, board, sn->bytes);
+}
+
+void* getSnapshot(Snapshots* sn, int i) {
+  return sn->boards + (long)i * sn->stride;
+}
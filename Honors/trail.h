@@ -1,44 +1,93 @@
 #ifndef TRAIL_H
 #define TRAIL_H
 
-#define GUESS 0
-#define VALUE 1
-
-#define MAX_CHANGES 1000
-
+// An undo log that saves a cell's whole state the first time a decision
+// level changes it, so no cell appears twice in one level. Along a search
+// path every entry stands for at least one lost candidate, which bounds
+// the log at sz candidates per cell; resetTrail sizes it for that.
 typedef struct Data {
-  int type;
   int cellID;
-  int value;
+  int ngs;          // candidates it had (its value was always 0)
+  long stamp;       // stamps[cellID] before this entry, put back on undo
+  Word gs[MAX_WORDS];
 } Data;
 
 typedef struct Trail {
   int sz;
   int max;
   Data* changes;
+  int ncells;       // largest board the trail is sized for
+  long level;       // stamp of the current decision level
+  long next;        // stamp the next level will get
+  long* stamps;     // per cell: level that last saved it
+  int depth;
+  long* levels;     // stamps of the levels below the current one
 } Trail;
 
+// One per decision level: where the level starts in the trail and the
+// guess made there. open says whether the alternative branch (the cell
+// without that digit) is still left to this search.
+typedef struct Mark {
+  int index;
+  int cell;
+  int guess;
+  int open;
+} Mark;
+
+// Levels a snapshot stack starts out with room for
+#define SNAPSHOT_LEVELS 32
+
 typedef struct Marks {
   int sz;
   int max;
-  int* marks;
+  Mark* marks;
 } Marks;
 
-Data makeData(int type, int ID, int v);
+// The other way of undoing guesses: a copy of the whole board from before
+// each one, all in one block that only grows when a search goes deeper
+// than any before it
+typedef struct Snapshots {
+  int sz;
+  int max;
+  int bytes;        // board size
+  int stride;       // bytes per slot, rounded up to keep boards aligned
+  char* boards;
+} Snapshots;
 
 Trail* makeTrail();
 Trail* reallocTrail(Trail* t);
 void freeTrail(Trail* t);
-void makeChange(Trail* t, int type, int ID, int v);
-Data extractChange(Trail* t);
+void resetTrail(Trail* t, int sz);
+void enterLevel(Trail* t);
+void leaveLevel(Trail* t, int index);
 
-void setValueT(Cell* c, int v, int sz, Trail* t);
-int removeGuessT(Cell* c, int n, Trail* t);
+// Logs cell id's state unless this level already has
+static inline void saveCell(Trail* t, int id, const Word* gs, int ngs, int nw) {
+  if (t->stamps[id] == t->level)
+    return;
+  if (t->sz == t->max)
+    reallocTrail(t);
+  Data* d = &t->changes[t->sz++];
+  d->cellID = id;
+  d->ngs = ngs;
+  d->stamp = t->stamps[id];
+  for (int i = 0; i < nw; i++)
+    d->gs[i] = gs[i];
+  t->stamps[id] = t->level;
+}
 
 Marks* createMarks();
 Marks* reallocMarks(Marks* m);
+void resetMarks(Marks* m, int depth);
 void freeMarks(Marks* m);
-void addMark(Marks* m, int index);
-int extractMark(Marks* m);
+void addMark(Marks* m, int index, int cell, int guess, int open);
+Mark extractMark(Marks* m);
+
+Snapshots* makeSnapshots();
+void freeSnapshots(Snapshots* sn);
+void reallocSnapshots(Snapshots* sn);
+void resetSnapshots(Snapshots* sn, int bytes);
+void pushSnapshot(Snapshots* sn, const void* board);
+void* getSnapshot(Snapshots* sn, int i);
 
 #endif